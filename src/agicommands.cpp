@@ -19,6 +19,9 @@
  */
 
 
+#include <string_view>
+#include <unordered_map>
+
 #include "agicommands.h"
 
 
@@ -268,3 +271,31 @@ void CorrectCommands(long VerNum)
     else
         NumAGICommands = 181;
 }
+
+//*******************************************************
+// Index of the first command in 'commands' (of size 'num') with each name
+static std::unordered_map<std::string_view, int> CommandIndex(const CommandStruct *commands, int num)
+{
+    std::unordered_map<std::string_view, int> index;
+    for (int i = 0; i < num; i++)
+        index.emplace(commands[i].Name, i);
+    return index;
+}
+
+//*******************************************************
+// The names never change, so all of AGICommand is indexed once; the
+// commands past NumAGICommands are left out when they are looked up.
+int FindAGICommand(const std::string &name)
+{
+    static const auto index = CommandIndex(AGICommand, sizeof(AGICommand) / sizeof(AGICommand[0]));
+    auto iter = index.find(name);
+    return (iter != index.end() && iter->second <= NumAGICommands) ? iter->second : -1;
+}
+
+//*******************************************************
+int FindTestCommand(const std::string &name)
+{
+    static const auto index = CommandIndex(TestCommand + 1, NumTestCommands);
+    auto iter = index.find(name);
+    return (iter != index.end()) ? iter->second + 1 : -1;
+}
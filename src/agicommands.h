@@ -21,6 +21,10 @@
 #ifndef AGI_COMMANDS_H
 #define AGI_COMMANDS_H
 
+
+#include <string>
+
+
 //argument types
 #define atNum  0
 #define atVar  1
@@ -50,4 +54,8 @@ extern CommandStruct AGICommand[182];  //all the other
 
 extern void  CorrectCommands(long VerNum);
 
+//number of the command called 'name', or -1 if there is none
+extern int FindAGICommand(const std::string &name);   //AGICommand[0..NumAGICommands]
+extern int FindTestCommand(const std::string &name);  //TestCommand[1..NumTestCommands]
+
 #endif
@@ -246,11 +246,11 @@ void play_sound(int ResNum)
         return;
     }
 
-    int err = game->ReadResource(SOUND, ResNum);
-    if (err)
+    AGIResource res = game->LoadResource(SOUND, ResNum);
+    if (res.empty())
         return;
 
-    play_song(ResourceData.Data, ResourceData.Size);
+    play_song(res.Data.data(), res.Size());
 
     close_sound();
 }
@@ -267,11 +267,11 @@ void play_sound(const std::string &filename)
         menu->errmes("Can't open file '%s'!", filename.c_str());
         return;
     }
-    ResourceData.Size = std::filesystem::file_size(filename);
-    res_stream.read(reinterpret_cast<char *>(ResourceData.Data), ResourceData.Size);
+    std::vector<byte> song(std::filesystem::file_size(filename));
+    res_stream.read(reinterpret_cast<char *>(song.data()), song.size());
     res_stream.close();
 
-    play_song(ResourceData.Data, ResourceData.Size);
+    play_song(song.data(), song.size());
 
     close_sound();
 }
@@ -23,19 +23,36 @@
  */
 
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <map>
+#include <thread>
 
+#include <QCoreApplication>
+#include <QCryptographicHash>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
-#include <QMessageBox>
+#include <QImage>
 #include <QProgressDialog>
 #include <QSettings>
 #include <QStatusBar>
+#include <QtEndian>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include "menu.h"
 #include "agicommands.h"
 #include "game.h"
 #include "logedit.h"
+#include "picture.h"
 
 
 const char *ResTypeName[4] =  {"logic", "picture", "view", "sound"};
@@ -43,19 +60,47 @@ const char *ResTypeAbbrv[4] = {"log", "pic", "view", "snd"};
 static const auto files =     {"VOL.0", "VIEWDIR", "LOGDIR", "SNDDIR", "PICDIR"};
 Game *game;
 
-static TResource CompressedResource;
-
 /******************************* LZW variables ****************************/
 #define MAXBITS 12
-#define TABLE_SIZE  18041
 #define START_BITS  9
+#define DICT_SIZE   4096    /* Codes are never longer than 11 bits */
 
-static int BITS, MAX_VALUE, MAX_CODE;
-static unsigned int *prefix_code;
-static byte *append_character;
-static byte decode_stack[4000];  /* Holds the decoded string */
-static int input_bit_count = 0;  /* Number of bits in input bit buffer */
-static unsigned long input_bit_buffer = 0L;
+// V3 LZW decoder. A dictionary entry is kept as the position and length of
+// its string in the output written so far, so a code is decoded by copying
+// bytes forward from earlier output - there's no decode stack to reverse.
+// The decoder allocates nothing, and each thread can have its own.
+class LZWDecoder
+{
+public:
+    bool expand(const byte *input, int inputLength, byte *output, int fileLength);
+private:
+    void setBITS(int value);
+    void refill();
+    unsigned int input_code();
+
+    typedef struct {
+        int Pos;        /* Start of the string in the output */
+        int Len;        /* Length of the string */
+    } TDictEntry;
+
+    int BITS, MAX_CODE;
+    const byte *input, *input_end;
+    quint64 input_bit_buffer;
+    int input_bit_count;      /* Number of bits in input bit buffer */
+    TDictEntry dict[DICT_SIZE];
+};
+
+/* Encoder hash table size: a prime well above the 2048 codes of 11 bits */
+#define HASH_SIZE   5021
+
+// Encoder state, one per compress() call
+typedef struct {
+    int code_value[HASH_SIZE];          /* -1 = empty slot */
+    unsigned int prefix_code[HASH_SIZE];
+    byte append_character[HASH_SIZE];
+    int output_bit_count;               /* Number of bits in output bit buffer */
+    unsigned long output_bit_buffer;
+} TLZWEncoder;
 //*******************************************
 
 const char EncryptionKey[] = "Avis Durgan";
@@ -69,7 +114,7 @@ TResource ResourceData;
  to do it...) */
 
 //*******************************************
-Game::Game() : ResourceInfo(), AGIVersionNumber(0), isOpen(false), isV3(false)
+Game::Game() : ResourceInfo(), AGIVersionNumber(0), isOpen(false), isV3(false), cache(ResourceCacheSize)
 {
     ResourceData.Data = (byte *)malloc(MaxResourceSize);
 
@@ -88,7 +133,11 @@ int Game::open(const std::string &gamepath)
     byte byte1, byte2, byte3;
     bool ErrorOccured = false;
 
+    stop_readers();
     dir = gamepath;
+    vols.reset(dir);
+    cache.clear();
+    FinishRebuild();
 
     for (CurResType = 0; CurResType <= 3; CurResType++) {
         for (CurResNum = 0; CurResNum <= 255; CurResNum++)
@@ -218,14 +267,37 @@ int Game::open(const std::string &gamepath)
 // Close current game
 int Game::close()
 {
+    stop_readers();
     isOpen = false;
+    vols.reset(dir);
+    cache.clear();
     return 0;
 }
 
+//*******************************************
+// Background readers are stopped (see BackgroundReader) whenever the
+// resource tables or the VOL files are about to change.
+void Game::add_reader(BackgroundReader *reader)
+{
+    readers.push_back(reader);
+}
+
+void Game::remove_reader(BackgroundReader *reader)
+{
+    std::erase(readers, reader);
+}
+
+void Game::stop_readers()
+{
+    for (auto reader : readers)
+        reader->stopReading();
+}
+
 //*******************************************
 // Create a new game (in 'path' folder) from template
 int Game::from_template(const std::string &path)
 {
+    stop_readers();
     dir = path;
     make_source_dir();
     auto template_dir = game->settings->value("TemplateDir").toString().toStdString();
@@ -287,7 +359,10 @@ int Game::newgame(const std::string &path)
         0x00, 0x00, 0x00, 0x00, 0x00, 0x9E, 0x00, 0x00, 0x01, 0x11, 0x06, 0x08, 0x10, 0x0D, 0x9B, 0x00,
         0x01, 0x00, 0x0D, 0x10, 0x93, 0x27, 0x0F, 0x00
     };
+    stop_readers();
     dir = path;
+    vols.reset(dir);
+    cache.clear();
 
     for (const auto &file : files)
         std::ofstream { std::filesystem::path(path) / file, std::ios::binary | std::ios::trunc };
@@ -355,24 +430,26 @@ long Game::GetAGIVersionNumber(void) const
     // Version 2.917 is the most common interpreter and
     // the one that all the "new" AGI games should be based on.
 
-    ResourceData.Size = 0;
+    std::vector<byte> data;
     auto data_file = std::filesystem::path(dir) / "AGIDATA.OVL";
     auto data_stream = std::ifstream(data_file, std::ios::binary);
     if (data_stream.is_open()) {
         int size = std::filesystem::file_size(data_file);
 
         if (size < MaxResourceSize) {
-            ResourceData.Size = size;
-            data_stream.read(reinterpret_cast<char *>(ResourceData.Data), ResourceData.Size);
+            data.resize(size);
+            data_stream.read(reinterpret_cast<char *>(data.data()), size);
         }
         data_stream.close();
     }
 
-    if (ResourceData.Size > 0) {
+    if (!data.empty()) {
+        int size = (int)data.size();
+        data.resize(size + 9, 0);  // the 9-byte window must not read past the end
         ResPos = 0;
         VerLen = 0;
-        while (ResPos < ResourceData.Size && VerLen == 0) {
-            memcpy(VersionNumBuffer, &ResourceData.Data[ResPos], 9);
+        while (ResPos < size && VerLen == 0) {
+            memcpy(VersionNumBuffer, &data[ResPos], 9);
             ResPos++;
             ISVerNum = true;
             if (VersionNumBuffer[1] == '.') {
@@ -415,75 +492,117 @@ long Game::GetAGIVersionNumber(void) const
 }
 
 //***************************************
-int Game::GetResourceSize(int ResType, int ResNum) const
+// Find resource 'ResNum' in its (memory-mapped) VOL file and check its header.
+int Game::ViewResource(const TResourceInfo &info, bool v3, TResourceView *view, bool report_errors) const
 {
-    unsigned char lsbyte, msbyte;
+    int err = vols.view(info.Filename, info.Loc, v3, view);
+    if (err && report_errors) {
+        switch (err) {
+            case VOL_ERR_OPEN:
+                menu->errmes("Error reading file '%s/%s'!", dir.c_str(), info.Filename);
+                break;
+            case VOL_ERR_PAST_END:
+                menu->errmes("Error reading '%s': Specified resource location is past end of file.", info.Filename);
+                break;
+            case VOL_ERR_NO_SIG:
+                menu->errmes("Error reading '%s': Resource signature not found.", info.Filename);
+                break;
+            case VOL_ERR_SIZE:
+                menu->errmes("Error reading '%s': Resource size 0!", info.Filename);
+                break;
+        }
+    }
+    return err;
+}
 
-    if (ResourceInfo[ResType][ResNum].Exists) {
-        const auto res_file = std::filesystem::path(dir) / ResourceInfo[ResType][ResNum].Filename;
+//***************************************
+int Game::GetResourceSize(int ResType, int ResNum) const
+{
+    TResourceView view;
 
-        auto res_stream = std::ifstream(res_file, std::ios::binary);
-        if (res_stream.is_open()) {
-            int size = std::filesystem::file_size(res_file);
+    if (ResourceInfo[ResType][ResNum].Exists && ViewResource(ResourceInfo[ResType][ResNum], isV3, &view, false) == VOL_OK)
+        return view.UncompressedSize;
+    return -1;
+}
 
-            if (size >= ResourceInfo[ResType][ResNum].Loc + 5) {
-                res_stream.seekg(ResourceInfo[ResType][ResNum].Loc);
-                res_stream.read(reinterpret_cast<char *>(&lsbyte), 1);
-                res_stream.read(reinterpret_cast<char *>(&msbyte), 1);
+//***************************************
+// Reads resource 'ResNum' from the VOL file (or the resource cache).
+// Returns an empty resource if it can't be read.
+AGIResource Game::LoadResource(int ResType, int ResNum, bool report_errors) const
+{
+    AGIResource res;
+    TCachedData data = LoadResourceData(ResType, ResNum, report_errors);
 
-                if (lsbyte == 0x12 && msbyte == 0x34) {
-                    res_stream.read(reinterpret_cast<char *>(&lsbyte), 1);
-                    res_stream.read(reinterpret_cast<char *>(&lsbyte), 1);
-                    res_stream.read(reinterpret_cast<char *>(&msbyte), 1);
-                    return (msbyte * 256 + lsbyte);
-                }
-            }
-            res_stream.close();
-        }
+    if (data) {
+        res.Type = ResType;
+        res.Num = ResNum;
+        res.Data = *data;
     }
-    return -1;
+    return res;
 }
 
 //***************************************
-// Reads resource 'ResNum' from the VOL file.
-int Game::ReadResource(int ResType, int ResNum)
+// Like LoadResource(), but returns the data shared with the resource cache
+// instead of a copy. Returns nullptr if the resource can't be read.
+TCachedData Game::LoadResourceData(int ResType, int ResNum, bool report_errors) const
 {
-    unsigned char msbyte, lsbyte;
+    return ReadResourceData(ResType, ResNum, ResourceInfo[ResType][ResNum], isV3, report_errors);
+}
 
-    if (isV3)
-        return ReadV3Resource(ResType, ResNum);
+//***************************************
+// LoadResourceData() for other threads, which must not read ResourceInfo
+// and isV3 (the GUI thread changes them). Errors are not reported.
+TCachedData Game::LoadResourceData(int ResType, int ResNum, const TResourceInfo &info, bool v3) const
+{
+    return ReadResourceData(ResType, ResNum, info, v3, false);
+}
 
-    const auto res_file = std::filesystem::path(dir) / ResourceInfo[ResType][ResNum].Filename;
-    auto res_stream = std::ifstream(res_file, std::ios::binary);
-    if (!res_stream.is_open()) {
-        menu->errmes("Error reading file '%s/%s'!", dir.c_str(), ResourceInfo[ResType][ResNum].Filename);
-        return 1;
-    }
+//***************************************
+TCachedData Game::ReadResourceData(int ResType, int ResNum, const TResourceInfo &info, bool v3, bool report_errors) const
+{
+    TCachedData cached = cache.raw(ResType, ResNum);
+    if (cached)
+        return cached;
 
-    int size = std::filesystem::file_size(res_file);
-    if (ResourceInfo[ResType][ResNum].Loc > size) {
-        menu->errmes("Error reading '%s': Specified resource location is past end of file.", ResourceInfo[ResType][ResNum].Filename);
-        return 1;
-    }
+    unsigned long generation = cache.generation();
+    TResourceView view;
+    std::vector<byte> data;
+    bool corrupt = false;
 
-    res_stream.seekg(ResourceInfo[ResType][ResNum].Loc);
-    res_stream.read(reinterpret_cast<char *>(&lsbyte), 1);
-    res_stream.read(reinterpret_cast<char *>(&msbyte), 1);
-    if (!(lsbyte == 0x12 && msbyte == 0x34)) {
-        menu->errmes("Error reading '%s': Resource signature not found.", ResourceInfo[ResType][ResNum].Filename);
-        return 1;
+    if (ViewResource(info, v3, &view, report_errors))
+        return nullptr;
+
+    if (v3) {
+        corrupt = ReadV3Resource(view, ResType, data);
+        if (corrupt && report_errors)
+            menu->errmes("Error reading %s.%03d: fatal error during code expansion!", ResTypeName[ResType], ResNum);
+    } else
+        data.assign(view.Data, view.Data + view.Size);
+
+    if ((int)data.size() > MaxResourceSize) {
+        if (report_errors)
+            menu->errmes("Error reading %s.%03d: resource is too big!", ResTypeName[ResType], ResNum);
+        return nullptr;
     }
+    if (data.empty())
+        return nullptr;
 
-    res_stream.seekg(ResourceInfo[ResType][ResNum].Loc + 3);
-    res_stream.read(reinterpret_cast<char *>(&lsbyte), 1);
-    res_stream.read(reinterpret_cast<char *>(&msbyte), 1);
-    ResourceData.Size = msbyte * 256 + lsbyte;
-    if (ResourceData.Size == 0) {
-        menu->errmes("Error reading '%s': Resource size 0!", ResourceInfo[ResType][ResNum].Filename);
+    auto shared = std::make_shared<const std::vector<byte>>(std::move(data));
+    if (!corrupt)
+        cache.store_raw(ResType, ResNum, shared, generation);
+    return shared;
+}
+
+//***************************************
+// Reads resource 'ResNum' into ResourceData.
+int Game::ReadResource(int ResType, int ResNum)
+{
+    AGIResource res = LoadResource(ResType, ResNum);
+    if (res.empty())
         return 1;
-    }
-    res_stream.read(reinterpret_cast<char *>(ResourceData.Data), ResourceData.Size);
-    res_stream.close();
+
+    ResourceData.Size = res.Size();
+    memcpy(ResourceData.Data, res.Data.data(), res.Size());
 
     return 0;
 }
@@ -498,6 +617,7 @@ std::unique_ptr<std::fstream> Game::OpenPatchVol(int PatchVol, int *filesize) co
         patch_filename = "vol." + std::to_string(PatchVol);
     const auto patch_path = std::filesystem::path(dir) / patch_filename;
 
+    vols.invalidate(patch_filename);  // the file is about to be written to
     auto patch_stream = std::make_unique<std::fstream>(patch_path, std::ios::in | std::ios::out | std::ios::binary);
     if (!patch_stream->is_open())
         return nullptr;
@@ -579,18 +699,24 @@ std::unique_ptr<std::fstream> Game::OpenDirUpdate(int *dirsize, int ResType)
 }
 
 //***********************************************
-int Game::AddResource(int ResType, int ResNum)
+int Game::AddResource(const AGIResource &res)
 {
+    int ResType = res.Type, ResNum = res.Num;
     std::unique_ptr<std::fstream> file_stream, dir_stream;
     int filesize, dirsize;
     int PatchVol;
     byte ResHeader[7], DirByte[3];
     int off;
     byte lsbyte, msbyte;
+    std::vector<byte> packed;
 
+    stop_readers();
     if ((dir_stream = OpenDirUpdate(&dirsize, ResType)) == nullptr)
         return 1;
 
+    byte VolFlags = PackResource(res, packed);
+    const std::vector<byte> &stored = packed.empty() ? res.Data : packed;
+
     PatchVol = 0;
     file_stream = OpenPatchVol(PatchVol, &filesize); //open vol.0
     if (file_stream == nullptr) {
@@ -599,7 +725,7 @@ int Game::AddResource(int ResType, int ResNum)
     }
 
     do {
-        if (filesize + ResourceData.Size > 1048000) {
+        if (filesize + (int)stored.size() > 1048000) {
             // Current volume is too big (to fit a diskette) - create the next one...
             file_stream.reset();
             PatchVol++;
@@ -612,7 +738,7 @@ int Game::AddResource(int ResType, int ResNum)
                 return 1;
             }
         }
-    } while (filesize + ResourceData.Size > 1048000);
+    } while (filesize + (int)stored.size() > 1048000);
 
     //write the resource to the patch volume and update the DIR file
     if (isV3) {
@@ -644,15 +770,15 @@ int Game::AddResource(int ResType, int ResNum)
     int n = 0;
     ResHeader[n++] = 0x12;
     ResHeader[n++] = 0x34;
-    ResHeader[n++] = PatchVol;
-    ResHeader[n++] = ResourceData.Size % 256;
-    ResHeader[n++] = ResourceData.Size / 256;
+    ResHeader[n++] = PatchVol | VolFlags;
+    ResHeader[n++] = res.Size() % 256;
+    ResHeader[n++] = res.Size() / 256;
     if (isV3) {
-        ResHeader[n++] = ResourceData.Size % 256;  // no compression so compressed size
-        ResHeader[n++] = ResourceData.Size / 256;  // and uncompressed size are the same
+        ResHeader[n++] = stored.size() % 256;  // compressed size (the same as the
+        ResHeader[n++] = stored.size() / 256;  // uncompressed size if not compressed)
     }
     file_stream->write(reinterpret_cast<char *>(ResHeader), n);
-    file_stream->write(reinterpret_cast<char *>(ResourceData.Data), ResourceData.Size);
+    file_stream->write(reinterpret_cast<const char *>(stored.data()), stored.size());
 
     if (isV3) {
         dir_stream->seekp(ResType * 2);
@@ -668,16 +794,31 @@ int Game::AddResource(int ResType, int ResNum)
         dir_stream.reset();
     }
     file_stream->flush();
+    cache.invalidate(ResType, ResNum);
 
     return 0;
 }
 
+//***********************************************
+// Adds the resource in ResourceData.
+int Game::AddResource(int ResType, int ResNum)
+{
+    AGIResource res;
+    res.Type = ResType;
+    res.Num = ResNum;
+    res.Data.assign(ResourceData.Data, ResourceData.Data + ResourceData.Size);
+    return AddResource(res);
+}
+
 //************************************************
 int Game::DeleteResource(int ResType, int ResNum)
 {
     std::unique_ptr<std::fstream> dir_stream;
     int dirsize;
 
+    stop_readers();
+    cache.invalidate(ResType, ResNum);
+
     if ((dir_stream = OpenDirUpdate(&dirsize, ResType)) == nullptr)
         return 1;
 
@@ -713,250 +854,330 @@ int Game::DeleteResource(int ResType, int ResNum)
     return 0;
 }
 
-//************************************************
+//***********************************************
+// Files written by RebuildVOLfiles() are published through this journal
+// (see FinishRebuild).
+#define REBUILD_JOURNAL "rebuild.journal"
+
+//***********************************************
+// Writes a whole file and waits until it is on the disk, so that it can't
+// be found empty or truncated after a crash once it has been renamed.
+static bool WriteWholeFile(const std::filesystem::path &path, const std::vector<byte> &data)
+{
+#ifdef _WIN32
+    FILE *fptr = _wfopen(path.c_str(), L"wb");
+#else
+    FILE *fptr = fopen(path.c_str(), "wb");
+#endif
+    if (fptr == NULL)
+        return false;
+    bool ok = (fwrite(data.data(), 1, data.size(), fptr) == data.size()) && fflush(fptr) == 0;
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(fptr)) == 0;
+#else
+    ok = ok && fsync(fileno(fptr)) == 0;
+#endif
+    return (fclose(fptr) == 0) && ok;
+}
+
+//***********************************************
+// Waits until the files created, renamed and deleted in directory 'path'
+// are on the disk. Windows has no such call for directories; NTFS journals
+// its directory changes itself.
+static void SyncDirectory(const std::filesystem::path &path)
+{
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        ::close(fd);
+    }
+#else
+    (void)path;
+#endif
+}
+
+//***********************************************
+// Completes an interrupted VOL rebuild: carries out the deletes and renames
+// listed in the rebuild journal. The journal is only created once all the
+// new files are written, and the game files are only touched after that,
+// so the DIR and VOL files are either all old or (after this) all new.
+int Game::FinishRebuild()
+{
+    auto journal_path = std::filesystem::path(dir) / REBUILD_JOURNAL;
+    std::ifstream journal(journal_path);
+    if (!journal.is_open())
+        return 0;
+
+    // "D <tab> name" (old file to delete) or "R <tab> from <tab> to"
+    std::vector<std::string> deletes;
+    std::vector<std::pair<std::string, std::string>> renames;
+    std::string line;
+    while (std::getline(journal, line)) {
+        auto tab1 = line.find('\t');
+        auto tab2 = line.find('\t', tab1 + 1);
+        if (line.starts_with("D\t"))
+            deletes.push_back(line.substr(tab1 + 1));
+        else if (line.starts_with("R\t") && tab2 != std::string::npos)
+            renames.emplace_back(line.substr(tab1 + 1, tab2 - tab1 - 1), line.substr(tab2 + 1));
+    }
+    journal.close();
+
+    vols.reset(dir);
+    cache.clear();
+
+    std::error_code ec;
+    for (const auto &name : deletes) {
+        // if the rebuild was interrupted, this may already be a new file
+        bool replaced = false;
+        for (const auto &rename : renames) {
+            if (QString(rename.second.c_str()).compare(name.c_str(), Qt::CaseInsensitive) == 0
+                    && !std::filesystem::exists(std::filesystem::path(dir) / rename.first))
+                replaced = true;
+        }
+        if (!replaced)
+            std::filesystem::remove(std::filesystem::path(dir) / name, ec);
+    }
+
+    int err = 0;
+    for (const auto &rename : renames) {
+        auto from = std::filesystem::path(dir) / rename.first;
+        if (std::filesystem::exists(from)) {
+            std::filesystem::rename(from, std::filesystem::path(dir) / rename.second, ec);
+            if (ec)
+                err = 1;
+        }
+    }
+
+    if (err) {
+        menu->errmes("Error replacing the VOL and DIR files with the rebuilt ones!");
+        return 1;
+    }
+    SyncDirectory(dir);  // the journal must last until the renames do
+    std::filesystem::remove(journal_path, ec);
+    return 0;
+}
+
+//***********************************************
+// Writes all resources into new VOL files, without the unused space
+// left by deleted and replaced resources.
 int Game::RebuildVOLfiles()
 {
-    int step = 0, steps = 0;
     int ResType, ResNum, VolFileNum;
-    std::ofstream vol_stream, dir_stream;
-    byte b = 0xff, byte1, byte2, byte3;
     byte ResHeader[7];
     long off;
 #define MaxVOLFileSize  1023*1024
     TResourceInfo NewResourceInfo[4][256];
     int ResourceNum[4];
-    bool cancel = false;
     int DirOffset[4];
     std::string volname = "vol";
-
+    std::vector<std::string> new_files;   // written so far (*.new)
+    std::vector<byte> vol_data;           // VOL file being built
+    std::vector<byte> dir_data[4];        // DIR files (just one in v3 games)
+    std::vector<byte> packed;             // compressed resource (v3 games)
+    int steps = 0, step = 0;
+    double total_bytes = 0;
+
+    stop_readers();
     if (isV3)
         volname = ID + "vol";
 
     for (ResType = 0; ResType <= 3; ResType++) {
-        ResourceNum[ResType] = 0;
+        ResourceNum[ResType] = -1;
         for (ResNum = 0; ResNum < 256; ResNum++) {
             if (ResourceInfo[ResType][ResNum].Exists) {
-                steps++;  //number of steps for the progress bar (if necessary)
+                steps++;
                 ResourceNum[ResType] = ResNum;
             }
         }
     }
 
-    QProgressDialog progress("Rebuilding VOL files...", "Cancel", 0, 100, nullptr);  //shows up if the operation is taking more than 3 sec
-    //(so it never shows up...)
-
-    ResHeader[0] = 0x12;
-    ResHeader[1] = 0x34;
-
-    VolFileNum = 0;
-    auto vol_path = std::filesystem::path(dir) / (volname + "." + std::to_string(VolFileNum) + ".new");
-    vol_stream = std::ofstream(vol_path, std::ios::binary | std::ios::trunc);
-    if (!vol_stream.is_open()) {
-        menu->errmes("Error creating file '%s'!", vol_path.string().c_str());
-        progress.cancel();
-        return 1;
-    }
-
+    // the DIR tables are built in memory, with all entries empty (0xff) at first
     if (isV3) {
-        auto dir_path = std::filesystem::path(dir) / (ID + "dir.new");
-        dir_stream = std::ofstream(dir_path, std::ios::binary | std::ios::trunc);
-        if (!dir_stream.is_open()) {
-            menu->errmes("Error creating file '%s'!", dir_path.string().c_str());
-            progress.cancel();
-            return 1;
-        }
+        dir_data[0].assign(8 + 4 * 0x300, 0xff);
         for (ResType = 0; ResType <= 3; ResType++) {
             DirOffset[ResType] = 8 + ResType * 0x300;
-            byte1 = DirOffset[ResType] % 0x100;
-            byte2 = DirOffset[ResType] / 0x100;
-            dir_stream.write(reinterpret_cast<char *>(&byte1), 1);
-            dir_stream.write(reinterpret_cast<char *>(&byte2), 1);
+            dir_data[0][ResType * 2] = DirOffset[ResType] % 0x100;
+            dir_data[0][ResType * 2 + 1] = DirOffset[ResType] / 0x100;
         }
+    } else {
         for (ResType = 0; ResType <= 3; ResType++) {
-            for (ResNum = 0; ResNum < 256; ResNum++) {
-                dir_stream.write(reinterpret_cast<char *>(&b), 1);
-                dir_stream.write(reinterpret_cast<char *>(&b), 1);
-                dir_stream.write(reinterpret_cast<char *>(&b), 1);
-            }
+            DirOffset[ResType] = 0;
+            dir_data[ResType].assign((ResourceNum[ResType] + 1) * 3, 0xff);
         }
-        dir_stream.flush();
-        dir_stream.seekp(0);
     }
 
-    for (ResType = 0; ResType <= 3; ResType++) {
-        if (!isV3) {
-            auto dir_path = std::filesystem::path(dir) / (std::string(ResTypeAbbrv[ResType]) + "dir.new");
-            dir_stream = std::ofstream(dir_path, std::ios::binary | std::ios::trunc);
-            if (!dir_stream.is_open()) {
-                menu->errmes("Error creating file '%s'!", dir_path.string().c_str());
-                progress.cancel();
-                return 1;
-            }
-            for (ResNum = 0; ResNum < ResourceNum[ResType]; ResNum++) {
-                dir_stream.write(reinterpret_cast<char *>(&b), 1);
-                dir_stream.write(reinterpret_cast<char *>(&b), 1);
-                dir_stream.write(reinterpret_cast<char *>(&b), 1);
-            }
-            dir_stream.flush();
-            dir_stream.seekp(0);
+    auto remove_new_files = [&]() {
+        std::error_code ec;
+        for (const auto &filename : new_files)
+            std::filesystem::remove(std::filesystem::path(dir) / (filename + ".new"), ec);
+    };
+    auto write_new_file = [&](const std::string &filename, const std::vector<byte> &data) {
+        auto path = std::filesystem::path(dir) / (filename + ".new");
+        new_files.push_back(filename);
+        if (!WriteWholeFile(path, data)) {
+            menu->errmes("Error creating file '%s'!", path.string().c_str());
+            return false;
         }
+        return true;
+    };
+
+    QProgressDialog progress("Rebuilding VOL files...", "Cancel", 0, steps, nullptr);
+    progress.setMinimumDuration(500);
+    QElapsedTimer timer;
+    timer.start();
 
+    ResHeader[0] = 0x12;
+    ResHeader[1] = 0x34;
+    VolFileNum = 0;
+    vol_data.reserve(MaxVOLFileSize);
+
+    for (ResType = 0; ResType <= 3; ResType++) {
         for (ResNum = 0; ResNum < 256; ResNum++) {
             if (!ResourceInfo[ResType][ResNum].Exists) {
                 NewResourceInfo[ResType][ResNum].Exists = false;
                 continue;
             }
-            if (ReadResource(ResType, ResNum)) {
+            AGIResource res = LoadResource(ResType, ResNum);
+            if (res.empty()) {
                 menu->errmes("Error saving '%s.%03d'!", ResTypeAbbrv[ResType], ResNum);
-                progress.cancel();
+                remove_new_files();
                 return 1;
             }
-            off = vol_stream.tellp();
-            if (off + ResourceData.Size + 5 > MaxVOLFileSize) {
-                vol_stream.close();
-                VolFileNum++;
-                auto vol_path = std::filesystem::path(dir) / (volname + "." + std::to_string(VolFileNum) + ".new");
-                vol_stream = std::ofstream(vol_path, std::ios::binary | std::ios::trunc);
-                if (!vol_stream.is_open()) {
-                    menu->errmes("Error creating file '%s'!", vol_path.string().c_str());
-                    progress.cancel();
+            byte VolFlags = PackResource(res, packed);
+            const std::vector<byte> &stored = packed.empty() ? res.Data : packed;
+            off = vol_data.size();
+            if (off + (long)stored.size() + 5 > MaxVOLFileSize) {
+                // this VOL file is full - write it and start the next one
+                if (!write_new_file(volname + "." + std::to_string(VolFileNum), vol_data)) {
+                    remove_new_files();
                     return 1;
                 }
-                off = vol_stream.tellp();
+                vol_data.clear();
+                VolFileNum++;
+                off = 0;
             }
             NewResourceInfo[ResType][ResNum].Exists = true;
             NewResourceInfo[ResType][ResNum].Loc = off;
             sprintf(NewResourceInfo[ResType][ResNum].Filename, "%s.%d", volname.c_str(), VolFileNum);
-            byte1 = VolFileNum * 0x10 + off / 0x10000;
-            byte2 = (off % 0x10000) / 0x100;
-            byte3 = off % 0x100;
-            ResHeader[2] = VolFileNum;
-            ResHeader[3] = ResourceData.Size % 256;
-            ResHeader[4] = ResourceData.Size / 256;
-            if (isV3) {
-                ResHeader[5] = ResourceData.Size % 256;
-                ResHeader[6] = ResourceData.Size / 256;
-                vol_stream.write(reinterpret_cast<char *>(ResHeader), 7);
-            } else
-                vol_stream.write(reinterpret_cast<char *>(ResHeader), 5);
-
-            vol_stream.write(reinterpret_cast<char *>(ResourceData.Data), ResourceData.Size);
-            if (isV3)
-                dir_stream.seekp(DirOffset[ResType] + ResNum * 3);
-            else
-                dir_stream.seekp(ResNum * 3);
-            dir_stream.write(reinterpret_cast<char *>(&byte1), 1);
-            dir_stream.write(reinterpret_cast<char *>(&byte2), 1);
-            dir_stream.write(reinterpret_cast<char *>(&byte3), 1);
-            progress.setValue(step++);
+
+            byte *entry = isV3 ? &dir_data[0][DirOffset[ResType] + ResNum * 3] : &dir_data[ResType][ResNum * 3];
+            entry[0] = VolFileNum * 0x10 + off / 0x10000;
+            entry[1] = (off % 0x10000) / 0x100;
+            entry[2] = off % 0x100;
+
+            ResHeader[2] = VolFileNum | VolFlags;
+            ResHeader[3] = res.Size() % 256;
+            ResHeader[4] = res.Size() / 256;
+            ResHeader[5] = stored.size() % 256;
+            ResHeader[6] = stored.size() / 256;
+            vol_data.insert(vol_data.end(), ResHeader, ResHeader + (isV3 ? 7 : 5));
+            vol_data.insert(vol_data.end(), stored.begin(), stored.end());
+            total_bytes += res.Size();
+
+            step++;
+            if (step % 16 == 0 || step == steps) {
+                double seconds = std::max(timer.elapsed(), (qint64)1) / 1000.0;
+                progress.setLabelText(QString::asprintf("Rebuilding VOL files...\n%d of %d resources\n%.0f resources/s, %.2f MB/s",
+                                                        step, steps, step / seconds, total_bytes / seconds / 1048576));
+            }
+            progress.setValue(step);
             if (progress.wasCanceled()) {
-                cancel = true;
-                break;
+                remove_new_files();
+                return 1;
             }
         }
-        if (!isV3)
-            dir_stream.close();
-
-        if (progress.wasCanceled()) {
-            cancel = true;
-            break;
-        }
     }
-    progress.setValue(steps);
 
-    vol_stream.close();
+    // write the last VOL file and the DIR files
+    bool ok = write_new_file(volname + "." + std::to_string(VolFileNum), vol_data);
     if (isV3)
-        dir_stream.close();
-
-    if (cancel)
+        ok = ok && write_new_file(ID + "dir", dir_data[0]);
+    else {
+        for (ResType = 0; ResType <= 3 && ok; ResType++)
+            ok = write_new_file(std::string(ResTypeAbbrv[ResType]) + "dir", dir_data[ResType]);
+    }
+    if (!ok) {
+        remove_new_files();
         return 1;
-
-    //cleanup temporary files
-    if (isV3) {
-        auto oldname = std::filesystem::path(dir) / (ID + "dir.new");
-        auto newname = std::filesystem::path(dir) / (ID + "dir");
-        std::filesystem::rename(oldname, newname);
-    } else {
-        for (const std::string &res_abbr : ResTypeAbbrv) {
-            auto oldname = std::filesystem::path(dir) / (res_abbr + "dir.new");
-            auto newname = std::filesystem::path(dir) / (res_abbr + "dir");
-            std::filesystem::rename(oldname, newname);
-        }
     }
+    progress.setValue(steps);
 
+    // Publish the new files: list what has to be done in the journal, make
+    // the journal appear in one step, then do it.
+    std::string journal;
     QDir d(dir.c_str());
-    // Delete old VOLs...
     QStringList list = d.entryList(QStringList() << QString(volname.c_str()) + ".?" << QString(volname.c_str()) + ".??");
     for (const auto &oldvol : list)
-        d.remove(oldvol);
-
-    // ...and replace them with the new ones:
-    list = d.entryList(QStringList() << QString(volname.c_str()) + ".*.new");
-    for (const auto &newvol : list) {
-        QString new_name = newvol;
-        new_name.replace(".new", "");
-        d.rename(newvol, new_name);
+        journal += "D\t" + oldvol.toStdString() + "\n";
+    for (const auto &filename : new_files)
+        journal += "R\t" + filename + ".new\t" + filename + "\n";
+    auto journal_path = std::filesystem::path(dir) / REBUILD_JOURNAL;
+    auto journal_tmp = std::filesystem::path(dir) / (std::string(REBUILD_JOURNAL) + ".new");
+    std::error_code ec;
+    if (!WriteWholeFile(journal_tmp, std::vector<byte>(journal.begin(), journal.end()))) {
+        menu->errmes("Error creating file '%s'!", journal_tmp.string().c_str());
+        remove_new_files();
+        return 1;
+    }
+    SyncDirectory(dir);  // the new files must be there before the journal
+    std::filesystem::rename(journal_tmp, journal_path, ec);
+    if (ec) {
+        menu->errmes("Error creating file '%s'!", journal_path.string().c_str());
+        std::filesystem::remove(journal_tmp, ec);
+        remove_new_files();
+        return 1;
     }
+    SyncDirectory(dir);  // and the journal before the old files are deleted
+
+    if (FinishRebuild())
+        return 1;
     memcpy(ResourceInfo, NewResourceInfo, sizeof(ResourceInfo));
-    QMessageBox::information(menu, "AGI studio", "Rebuilding is complete!");
+
+    double seconds = std::max(timer.elapsed(), (qint64)1) / 1000.0;
+    menu->infomes("Rebuilding is complete!\n%d resources (%.2f MB) in %.2f s: %.0f resources/s, %.2f MB/s.",
+                  steps, total_bytes / 1048576, seconds, steps / seconds, total_bytes / seconds / 1048576);
     return 0;
 }
 
 //***********************************************
 // v3 decompression code from Qt AGI Utilities
 
-static void initLZW()
-{
-    if (prefix_code == NULL) {
-        prefix_code = (unsigned int *)malloc(TABLE_SIZE * sizeof(unsigned int));
-        append_character = (byte *)malloc(TABLE_SIZE * sizeof(byte));
-    }
-}
-
-static void resetLZW()
-{
-    input_bit_count = 0;
-    input_bit_buffer = 0L;
-}
-
-
 /***************************************************************************
 ** setBITS
 **
 ** Purpose: To adjust the number of bits used to store codes to the value
-** passed in.
+** passed in. Like Sierra's decoder, it never goes up to MAXBITS.
 ***************************************************************************/
-static int setBITS(int value)
+void LZWDecoder::setBITS(int value)
 {
     if (value == MAXBITS)
-        return true;
+        return;
 
     BITS = value;
-    MAX_VALUE = (1 << BITS) - 1;
-    MAX_CODE = MAX_VALUE - 1;
-    return false;
+    MAX_CODE = (1 << BITS) - 2;
 }
 
 /***************************************************************************
-** decode_string
+** refill
 **
-** Purpose: To return the string that the code taken from the input buffer
-** represents. The string is returned as a stack, i.e. the characters are
-** in reverse order.
+** Purpose: To top up the bit buffer to at least 56 bits, a 64-bit word at
+** a time while there are 8 input bytes left. Bytes past the end of the
+** input are read as zeros.
 ***************************************************************************/
-static byte *decode_string(byte *buffer, unsigned int code)
+void LZWDecoder::refill()
 {
-    int i = 0;
-    while (code > 255) {
-        *buffer++ = append_character[code];
-        code = prefix_code[code];
-        if (i++ >= 4000) {
-            menu->errmes("Fatal error during code expansion!");
-            return nullptr;
+    if (input_end - input >= 8) {
+        input_bit_buffer |= qFromLittleEndian<quint64>(input) << input_bit_count;
+        input += (63 - input_bit_count) >> 3;
+        input_bit_count |= 56;
+    } else {
+        while (input_bit_count <= 56) {
+            if (input < input_end)
+                input_bit_buffer |= (quint64) * input++ << input_bit_count;
+            input_bit_count += 8;
         }
     }
-    *buffer = code;
-    return (buffer);
 }
 
 /***************************************************************************
@@ -964,16 +1185,12 @@ static byte *decode_string(byte *buffer, unsigned int code)
 **
 ** Purpose: To return the next code from the input buffer.
 ***************************************************************************/
-static unsigned int input_code(byte **input)
+inline unsigned int LZWDecoder::input_code()
 {
-    unsigned int return_value;
-
-    while (input_bit_count <= 24) {
-        input_bit_buffer |= (unsigned long) * (*input)++ << input_bit_count;
-        input_bit_count += 8;
-    }
+    if (input_bit_count < BITS)
+        refill();
 
-    return_value = (input_bit_buffer & 0x7FFF) % (1 << BITS);
+    unsigned int return_value = input_bit_buffer & ((1 << BITS) - 1);
     input_bit_buffer >>= BITS;
     input_bit_count -= BITS;
     return (return_value);
@@ -990,54 +1207,79 @@ static unsigned int input_code(byte **input)
 **
 **  code 256 = start over
 **  code 257 = end of data
+**
+** Returns false if the data contains a code that isn't defined yet.
 ***************************************************************************/
-static void expand(byte *input, byte *output, int fileLength)
+bool LZWDecoder::expand(const byte *in, int inputLength, byte *output, int fileLength)
 {
-    int next_code, new_code, old_code;
-    int character, /* counter=0, index, */ BITSFull /*, i */;
-    byte *string, *endAddr;
+    int next_code, out = 0;
+    int old_pos = 0, old_len = 0;   /* String of the previous code */
+    unsigned int new_code;
 
-    BITSFull = setBITS(START_BITS);  /* Starts at 9-bits */
-    next_code = 257;                 /* Next available code to define */
+    input = in;
+    input_end = in + inputLength;
+    input_bit_count = 0;
+    input_bit_buffer = 0;
 
-    endAddr = (byte *)((long)output + (long)fileLength);
+    setBITS(START_BITS);    /* Starts at 9-bits */
+    next_code = 257;        /* Next available code to define */
 
-    old_code = input_code(&input);    /* Read in the first code */
-    character = old_code;
-    new_code = input_code(&input);
+    input_code();           /* The first code (normally 256) isn't output */
+    new_code = input_code();
 
-    while ((output < endAddr) && (new_code != 0x101)) {
+    while ((out < fileLength) && (new_code != 0x101)) {
 
         if (new_code == 0x100) {      /* Code to "start over" */
             next_code = 258;
-            BITSFull = setBITS(START_BITS);
-            old_code = input_code(&input);
-            character = old_code;
-            *output++ = (char)character;
-            new_code = input_code(&input);
+            setBITS(START_BITS);
+            old_pos = out;
+            old_len = 1;
+            output[out++] = (byte)input_code();
         } else {
-            if (new_code >= next_code) { /* Handles special LZW scenario */
-                *decode_stack = character;
-                string = decode_string(decode_stack + 1, old_code);
+            int pos, len;
+
+            if (new_code < 0x100) {
+                pos = -1;
+                len = 1;
+            } else if ((int)new_code < next_code) {
+                pos = dict[new_code].Pos;
+                len = dict[new_code].Len;
+            } else if ((int)new_code == next_code) {
+                /* Special LZW scenario: the previous string plus its own
+                   first character, which the forward copy picks up */
+                pos = old_pos;
+                len = old_len + 1;
             } else
-                string = decode_string(decode_stack, new_code);
+                return false;
 
-            /* Reverse order of decoded string and store in output buffer. */
-            character = *string;
-            while (string >= decode_stack)
-                *output++ = *string--;
+            len = std::min(len, fileLength - out);
+            if (pos < 0)
+                output[out] = new_code;
+            else if (pos + len <= out)
+                memcpy(output + out, output + pos, len);
+            else {
+                for (int i = 0; i < len; i++)
+                    output[out + i] = output[pos + i];
+            }
 
             if (next_code > MAX_CODE)
-                BITSFull = setBITS(BITS + 1);
+                setBITS(BITS + 1);
 
-            prefix_code[next_code] = old_code;
-            append_character[next_code] = character;
+            /* The new code is the previous string plus the first character
+               of this one, which follows it directly in the output */
+            if (next_code < DICT_SIZE) {
+                dict[next_code].Pos = old_pos;
+                dict[next_code].Len = old_len + 1;
+            }
             next_code++;
-            old_code = new_code;
-
-            new_code = input_code(&input);
+            old_pos = out;
+            old_len = len;
+            out += len;
         }
+
+        new_code = input_code();
     }
+    return true;
 }
 
 //***********************************************
@@ -1046,19 +1288,24 @@ static void convertLOG(byte *logBuf, int logLen)
     int startPos, endPos, i, avisPos = 0, numMessages;
 
     /* Find the start and end of the message section */
+    if (logLen < 2)
+        return;
     startPos = *logBuf + (*(logBuf + 1)) * 256 + 2;
+    if (startPos + 3 > logLen)
+        return;
     numMessages = logBuf[startPos];
     endPos = logBuf[startPos + 1] + logBuf[startPos + 2] * 256;
     logBuf += (startPos + 3);
+    logLen -= (startPos + 3);
     startPos = (numMessages * 2) + 0;
 
-    /* Encrypt the message section so that it compiles with AGIv2 */
+    /* Encrypt (or decrypt) the message section so that it compiles with AGIv2 */
     for (i = startPos; i < endPos && i < logLen; i++)
         logBuf[i] ^= EncryptionKey[avisPos++ % 11];
 }
 
 //***********************************************
-static void DecompressPicture(byte *picBuf, byte *outBuf, int picLen, int *outLen)
+static void DecompressPicture(const byte *picBuf, byte *outBuf, int picLen, int *outLen)
 {
 #define  NORMAL     0
 #define  ALTERNATE  1
@@ -1079,7 +1326,7 @@ static void DecompressPicture(byte *picBuf, byte *outBuf, int picLen, int *outLe
         if ((outData == 0xF0) || (outData == 0xF2)) {
             *out++ = outData;
             if (mode == NORMAL) {
-                data = picBuf[bufPos++];
+                data = (bufPos < picLen) ? picBuf[bufPos++] : 0;
                 *out++ = (data & 0xF0) >> 4;
                 mode = ALTERNATE;
             } else {
@@ -1095,61 +1342,210 @@ static void DecompressPicture(byte *picBuf, byte *outBuf, int picLen, int *outLe
     *outLen = int(out - outBuf);
 }
 
-//***********************************************
-int Game::ReadV3Resource(char ResourceType1_c, int ResourceID1)
+// v3 compression code, the reverse of expand() and DecompressPicture()
+
+/***************************************************************************
+** find_match
+**
+** Purpose: To find the hash table slot of the string made of the prefix
+** code and the character passed in. If the string is not in the table,
+** the empty slot where it should go is returned.
+***************************************************************************/
+static int find_match(const TLZWEncoder *lzw, unsigned int prefix, unsigned int character)
 {
-    byte msbyte, lsbyte;
-    bool ResourceIsPicture;
-    byte VolNumByte;
-    int ResourceType1 = (int)ResourceType1_c;
-
-    if (CompressedResource.Data == nullptr)
-        CompressedResource.Data = (byte *)malloc(MaxResourceSize);
-
-    auto resource_path = std::filesystem::path(dir) / ResourceInfo[ResourceType1][ResourceID1].Filename;
-    auto resource_stream = std::ifstream(resource_path, std::ios::binary);
-    if (!resource_stream.is_open()) {
-        menu->errmes("Error reading file '%s'.", resource_path.string().c_str());
-        return 1;
+    int index = (character << 4) ^ prefix;
+    int offset = (index == 0) ? 1 : HASH_SIZE - index;
+
+    while (lzw->code_value[index] != -1) {
+        if (lzw->prefix_code[index] == prefix && lzw->append_character[index] == character)
+            break;
+        index -= offset;
+        if (index < 0)
+            index += HASH_SIZE;
     }
+    return index;
+}
 
-    int size = std::filesystem::file_size(resource_path);
-    if (ResourceInfo[ResourceType1][ResourceID1].Loc > size) {
-        menu->errmes("Error reading '%s': Specified resource location is past end of file.", ResourceInfo[ResourceType1][ResourceID1].Filename);
-        return 1;
+/***************************************************************************
+** code_bits
+**
+** Purpose: To return the code size the decoder reads with once it has
+** defined all codes below next_code. It switches to 10 and 11 bits when
+** it defines codes 511 and 1023 and never goes beyond 11 bits.
+***************************************************************************/
+static int code_bits(int next_code)
+{
+    if (next_code > 1023)
+        return 11;
+    if (next_code > 511)
+        return 10;
+    return START_BITS;
+}
+
+/***************************************************************************
+** output_code
+**
+** Purpose: To append a code to the output buffer, low bits first.
+***************************************************************************/
+static void output_code(TLZWEncoder *lzw, unsigned int code, int bits, std::vector<byte> &output)
+{
+    lzw->output_bit_buffer |= (unsigned long)code << lzw->output_bit_count;
+    lzw->output_bit_count += bits;
+    while (lzw->output_bit_count >= 8) {
+        output.push_back(lzw->output_bit_buffer & 0xFF);
+        lzw->output_bit_buffer >>= 8;
+        lzw->output_bit_count -= 8;
     }
-    resource_stream.seekg(ResourceInfo[ResourceType1][ResourceID1].Loc);
-    resource_stream.read(reinterpret_cast<char *>(&lsbyte), 1);
-    resource_stream.read(reinterpret_cast<char *>(&msbyte), 1);
-    if (!(lsbyte == 0x12 && msbyte == 0x34)) {
-        menu->errmes("Error reading '%s': Resource signature not found.", ResourceInfo[ResourceType1][ResourceID1].Filename);
-        return 1;
+}
+
+/***************************************************************************
+** compress
+**
+** Purpose: To compress the input buffer into the output buffer in the
+** format read by expand(). The stream starts with code 256 and ends with
+** code 257. When all 11-bit codes are used up, code 256 is sent and the
+** table is started over.
+**
+** The decoder defines each code one step after the encoder (when it reads
+** the following code), so the code size is chosen from next_code - 1.
+***************************************************************************/
+static void compress(const byte *input, int inputLength, std::vector<byte> &output)
+{
+    int next_code, index;
+    unsigned int string_code, character;
+
+    output.clear();
+    if (inputLength <= 0)
+        return;
+    output.reserve(inputLength);
+
+    auto lzw = std::make_unique<TLZWEncoder>();
+    std::fill_n(lzw->code_value, HASH_SIZE, -1);
+    lzw->output_bit_count = 0;
+    lzw->output_bit_buffer = 0L;
+
+    next_code = 258;
+    output_code(lzw.get(), 0x100, START_BITS, output);
+
+    string_code = *input++;
+    while (--inputLength > 0) {
+        character = *input++;
+        index = find_match(lzw.get(), string_code, character);
+        if (lzw->code_value[index] != -1) {
+            string_code = lzw->code_value[index];
+            continue;
+        }
+
+        output_code(lzw.get(), string_code, code_bits(next_code - 1), output);
+        if (next_code < 2048) {
+            lzw->code_value[index] = next_code++;
+            lzw->prefix_code[index] = string_code;
+            lzw->append_character[index] = character;
+        } else {
+            /* The table is full - start over */
+            output_code(lzw.get(), 0x100, code_bits(next_code), output);
+            std::fill_n(lzw->code_value, HASH_SIZE, -1);
+            next_code = 258;
+        }
+        string_code = character;
     }
 
-    resource_stream.read(reinterpret_cast<char *>(&VolNumByte), 1);
-    ResourceIsPicture = ((VolNumByte & 0x80) == 0x80);
-    resource_stream.read(reinterpret_cast<char *>(&lsbyte), 1);
-    resource_stream.read(reinterpret_cast<char *>(&msbyte), 1);
-    ResourceData.Size = msbyte * 256 + lsbyte;
-    resource_stream.read(reinterpret_cast<char *>(&lsbyte), 1);
-    resource_stream.read(reinterpret_cast<char *>(&msbyte), 1);
-    CompressedResource.Size = msbyte * 256 + lsbyte;
-    resource_stream.read(reinterpret_cast<char *>(CompressedResource.Data), CompressedResource.Size);
-
-    if (ResourceIsPicture)
-        DecompressPicture(CompressedResource.Data, ResourceData.Data, CompressedResource.Size, &ResourceData.Size);
-    else if (CompressedResource.Size != ResourceData.Size) {
-        initLZW();
-        resetLZW();
-        expand(CompressedResource.Data, ResourceData.Data, ResourceData.Size);
-        if (ResourceType1 == LOGIC)
-            convertLOG(ResourceData.Data, ResourceData.Size);
-    } else {
-        ResourceData.Size = CompressedResource.Size;
-        memcpy(ResourceData.Data, CompressedResource.Data, ResourceData.Size);
+    output_code(lzw.get(), string_code, code_bits(next_code - 1), output);
+    output_code(lzw.get(), 0x101, code_bits(next_code), output);
+    if (lzw->output_bit_count > 0)
+        output.push_back(lzw->output_bit_buffer & 0xFF);
+}
+
+//***********************************************
+// Packs the colour byte after each 0xF0/0xF2 command into a nibble.
+// Returns false if the picture can't be stored that way (a colour
+// above 15, or a colour command at the very end).
+static bool CompressPicture(const byte *picBuf, int picLen, std::vector<byte> &outBuf)
+{
+    bool half = false;   // the last output byte is waiting for its low nibble
+
+    auto put_nibble = [&](byte nibble) {
+        if (half)
+            outBuf.back() |= nibble;
+        else
+            outBuf.push_back(nibble << 4);
+        half = !half;
+    };
+
+    outBuf.clear();
+    outBuf.reserve(picLen);
+    for (int bufPos = 0; bufPos < picLen; bufPos++) {
+        byte data = picBuf[bufPos];
+        if (!half)
+            outBuf.push_back(data);
+        else {
+            put_nibble(data >> 4);
+            put_nibble(data & 0x0F);
+        }
+        if (data == 0xF0 || data == 0xF2) {
+            if (bufPos + 1 >= picLen || picBuf[bufPos + 1] > 0x0F)
+                return false;
+            put_nibble(picBuf[++bufPos]);
+        }
     }
+    return true;
+}
 
-    return 0;
+//***********************************************
+// Decodes a v3 resource straight from the mapped VOL file.
+// Returns 1 if the compressed data is corrupt (what could be decoded is kept).
+int Game::ReadV3Resource(const TResourceView &view, int ResType, std::vector<byte> &data) const
+{
+    bool ResourceIsPicture = ((view.VolByte & 0x80) == 0x80);
+    int err = 0;
+
+    if (ResourceIsPicture) {
+        // every input byte gives at most 2 output bytes
+        int size;
+        data.resize(std::max(view.UncompressedSize, view.Size * 2));
+        DecompressPicture(view.Data, data.data(), view.Size, &size);
+        data.resize(size);
+    } else if (view.Compressed) {
+        LZWDecoder lzw;
+        data.resize(view.UncompressedSize);
+        if (!lzw.expand(view.Data, view.Size, data.data(), view.UncompressedSize))
+            err = 1;
+        if (ResType == LOGIC)
+            convertLOG(data.data(), data.size());
+    } else
+        data.assign(view.Data, view.Data + view.Size);
+
+    return err;
+}
+
+//***********************************************
+// Compresses a v3 resource the way Sierra stored it: pictures with their
+// colours packed into nibbles, everything else with LZW (logics with their
+// messages unencrypted). 'packed' is left empty if the resource should be
+// stored as it is. Returns the bits to set in the vol byte of the resource
+// header (0x80 for a compressed picture).
+byte Game::PackResource(const AGIResource &res, std::vector<byte> &packed) const
+{
+    packed.clear();
+    if (!isV3 || !settings->value("CompressV3Resources", true).toBool())
+        return 0;
+
+    if (res.Type == PICTURE) {
+        if (!CompressPicture(res.Data.data(), res.Size(), packed))
+            packed.clear();
+    } else if (res.Type == LOGIC) {
+        std::vector<byte> data = res.Data;
+        convertLOG(data.data(), data.size());
+        compress(data.data(), data.size(), packed);
+    } else
+        compress(res.Data.data(), res.Size(), packed);
+
+    // a resource is only read as compressed if its size has changed
+    if (packed.size() >= res.Data.size()) {
+        packed.clear();
+        return 0;
+    }
+    return (res.Type == PICTURE) ? 0x80 : 0;
 }
 
 //*********************************************************
@@ -1169,6 +1565,7 @@ void Game::reset_settings(void)
     settings->setValue("DefaultResourceType", VIEW);                // Default resource type in resources window at startup.
     settings->setValue("PictureEditorStyle", P_ONE);                // PicEdit Window style.
     settings->setValue("ExtractLogicAsText", true);                 // Default for 'extract' function.
+    settings->setValue("CompressV3Resources", true);                // Compress resources written to v3 VOL files.
 
     settings->setValue("LogicEditor/ShowAllMessages", true);        // Logic decompiler - show all messages at end, or just unused ones.
     settings->setValue("LogicEditor/ShowElsesAsGotos", false);      //
@@ -1186,12 +1583,78 @@ void Game::reset_settings(void)
     settings->setValue("InterpreterArgs", "");                      // Interpreter command-line arguments.
 }
 
-//************************************************
+//*********************************************************
+// Writes resource 'ResNum' to a file (a logic can be written as source text).
+int Game::ExtractResource(const std::string &filename, int ResType, int ResNum, bool LogicAsText)
+{
+    AGIResource res = LoadResource(ResType, ResNum);
+    if (res.empty())
+        return 1;
+
+    std::string text;
+    if (ResType == LOGIC && LogicAsText) {
+        Logic logic;
+        if (logic.decode(ResNum)) {
+            menu->errmes("Errors in logic.%03d:\n%s", ResNum, logic.ErrorList.c_str());
+            return 1;
+        }
+        text = logic.OutputText;
+    }
+
+    QFile outfile(filename.c_str());
+    if (!outfile.open(QIODevice::WriteOnly)) {
+        menu->errmes("Can't open file '%s'!", filename.c_str());
+        return 1;
+    }
+    if (ResType == LOGIC && LogicAsText)
+        outfile.write(text.c_str());
+    else
+        outfile.write(reinterpret_cast<const char *>(res.Data.data()), res.Size());
+    outfile.close();
+
+    return 0;
+}
+
+//*********************************************************
+// One logic of RecompileAll(): the source is read in the GUI thread,
+// compiled in a worker thread and then added to the game in the GUI thread.
+typedef struct {
+    int ResNum;
+    QStringList Source;
+    QString SourceHash;
+    int err;
+    AGIResource Resource;
+    QStringList IncludedFiles;
+    std::string ErrorList;
+} TRecompileJob;
+
+//*********************************************************
+static QString DataHash(const QByteArray &data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex();
+}
+
+static QString DataHash(const std::vector<byte> &data)
+{
+    return DataHash(QByteArray(reinterpret_cast<const char *>(data.data()), data.size()));
+}
+
+//*********************************************************
+// Hash of a file, or an empty string if the file can't be read.
+static QString FileHash(const std::string &path)
+{
+    QFile file(path.c_str());
+    if (!file.open(QIODevice::ReadOnly))
+        return "";
+    return DataHash(file.readAll());
+}
+
+//*********************************************************
 int Game::RecompileAll()
 {
     int i, ResNum, err;
-    Logic logic;
-    extern QStringList InputLines;
+    std::vector<TRecompileJob> jobs;
+    int skipped = 0, failed = 0;
 
     for (i = 0; i < MAXWIN; i++) {
         if (winlist[i].type == TEXTRES) {
@@ -1207,67 +1670,250 @@ int Game::RecompileAll()
         }
     }
 
-    int step = 0, steps = 0;
+    // WORDS.TOK and OBJECT are read once and shared by all compilers
+    Logic lists;
+    if (lists.ReadLists())
+        return 1;
+
+    // Hashes of the inputs of every logic as of its last compilation.
+    // A logic is only recompiled if one of them has changed (or if the
+    // logic in the game is not the one that was compiled).
+    QSettings deps(QString::fromStdString(srcdir + "/recompile.ini"), QSettings::IniFormat);
+    QString words_hash = FileHash(dir + "/words.tok");
+    QString object_hash = FileHash(dir + "/object");
+    QString version = QString::number(AGIVersionNumber);
+    std::map<QString, QString> include_hashes;
+    auto include_hash = [&](const QString &filename) {
+        if (!include_hashes.contains(filename))
+            include_hashes[filename] = FileHash(dir + "/src/" + filename.toStdString());
+        return include_hashes[filename];
+    };
+    auto up_to_date = [&](const TRecompileJob &job) {
+        deps.beginGroup(QString::asprintf("logic.%03d", job.ResNum));
+        bool ok = deps.value("source").toString() == job.SourceHash
+                  && deps.value("words").toString() == words_hash
+                  && deps.value("object").toString() == object_hash
+                  && deps.value("version").toString() == version;
+        QStringList includes = deps.value("includes").toStringList();
+        QStringList hashes = deps.value("include_hashes").toStringList();
+        ok = ok && includes.count() == hashes.count();
+        for (int k = 0; ok && k < includes.count(); k++)
+            ok = (include_hash(includes.at(k)) == hashes.at(k));
+        QString output = deps.value("output").toString();
+        deps.endGroup();
+        if (ok)
+            ok = (DataHash(LoadResource(LOGIC, job.ResNum, false).Data) == output);
+        return ok;
+    };
+
     for (ResNum = 0; ResNum < 256; ResNum++) {
-        if (game->ResourceInfo[LOGIC][ResNum].Exists)
-            steps++;
+        if (!game->ResourceInfo[LOGIC][ResNum].Exists)
+            continue;
+
+        TRecompileJob job;
+        job.ResNum = ResNum;
+        job.err = 1;
+
+        // Look for a source file first
+        std::ifstream logic_stream;
+        for (const auto &filename_fmt : {
+                    "logic.%03d", "logic.%d", "logic%d.txt"
+                }) {
+            auto logic_path = std::filesystem::path(game->srcdir) / QString::asprintf(filename_fmt, ResNum).toStdString();
+            if (std::filesystem::exists(logic_path)) {
+                logic_stream = std::ifstream(logic_path);
+                break;
+            }
+        }
+
+        if (logic_stream.is_open()) {
+            std::string newline;
+            while (std::getline(logic_stream, newline))
+                job.Source.append(newline.c_str());
+            logic_stream.close();
+        } else { //source file not found - reading from the game
+            err = lists.decode(ResNum);
+            if (err) {
+                menu->errmes("Errors in logic.%03d:\n%s", ResNum, lists.ErrorList.c_str());
+                failed++;
+                continue;
+            }
+            std::string::size_type pos;
+            std::string str = lists.OutputText;
+            while ((pos = str.find_first_of("\n")) != std::string::npos) {
+                job.Source.append(str.substr(0, pos).c_str());
+                str = str.substr(pos + 1);
+            }
+            if (str != "")
+                job.Source.append(str.c_str());
+        }
+
+        job.SourceHash = DataHash(job.Source.join("\n").toUtf8());
+        if (up_to_date(job)) {
+            skipped++;
+            continue;
+        }
+        jobs.push_back(std::move(job));
     }
 
-    QProgressDialog progress("Recompiling all logics...", "Cancel", 0, 100, nullptr);
+    QProgressDialog progress("Recompiling all logics...", "Cancel", 0, jobs.size(), nullptr);
     progress.setMinimumDuration(0);
 
-    for (ResNum = 0; ResNum < 256; ResNum++) {
-        if (game->ResourceInfo[LOGIC][ResNum].Exists) {
-
-            // Look for a source file first
-            std::ifstream logic_stream;
-            for (const auto &filename_fmt : {
-                        "logic.%03d", "logic.%d", "logic%d.txt"
-                    }) {
-                auto logic_path = std::filesystem::path(game->srcdir) / QString::asprintf(filename_fmt, ResNum).toStdString();
-                if (std::filesystem::exists(logic_path)) {
-                    logic_stream = std::ifstream(logic_path);
-                    break;
-                }
+    // Compile on all cores. Each thread has its own Logic object; the
+    // include files are read once and shared.
+    IncludeCache includes;
+    std::atomic<int> next_job(0), jobs_done(0);
+    std::atomic<bool> cancel(false);
+    auto compile_jobs = [&]() {
+        auto logic = std::make_unique<Logic>();
+        *logic->wordlist = *lists.wordlist;
+        *logic->objlist = *lists.objlist;
+        logic->includecache = &includes;
+        int n;
+        while (!cancel && (n = next_job++) < (int)jobs.size()) {
+            logic->InputLines = jobs[n].Source;
+            jobs[n].err = logic->compile(true);
+            jobs[n].Resource = std::move(logic->Resource);
+            jobs[n].IncludedFiles = logic->IncludedFiles;
+            jobs[n].ErrorList = logic->ErrorList;
+            jobs_done++;
+        }
+    };
+
+    int num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    num_threads = std::min(num_threads, std::max(1, (int)jobs.size()));
+    std::vector<std::thread> threads;
+    for (i = 0; i < num_threads; i++)
+        threads.emplace_back(compile_jobs);
+
+    while (jobs_done < (int)jobs.size()) {
+        progress.setValue(jobs_done);
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 50);
+        if (progress.wasCanceled()) {
+            cancel = true;
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    for (auto &thread : threads)
+        thread.join();
+    if (cancel)
+        return 1;
+
+    // Write the results in the order of a serial build, so that the
+    // VOL and DIR files come out exactly the same
+    for (auto &job : jobs) {
+        deps.beginGroup(QString::asprintf("logic.%03d", job.ResNum));
+        if (!job.err) {
+            job.Resource.Num = job.ResNum;
+            if (game->AddResource(job.Resource) == 0) {
+                QStringList hashes;
+                for (const auto &filename : job.IncludedFiles)
+                    hashes.append(include_hash(filename));
+                deps.setValue("source", job.SourceHash);
+                deps.setValue("words", words_hash);
+                deps.setValue("object", object_hash);
+                deps.setValue("version", version);
+                deps.setValue("includes", job.IncludedFiles);
+                deps.setValue("include_hashes", hashes);
+                deps.setValue("output", DataHash(job.Resource.Data));
+            } else {
+                deps.remove("");
+                failed++;
             }
+        } else {
+            deps.remove("");
+            failed++;
+            if (!job.ErrorList.empty())
+                menu->errmes("Errors in logic.%03d:\n%s", job.ResNum, job.ErrorList.c_str());
+        }
+        deps.endGroup();
+    }
+
+    progress.setValue(jobs.size());
+    if (skipped > 0)
+        menu->infomes("Recompilation is complete!\n%d unchanged logics were skipped.", skipped);
+    else
+        menu->infomes("Recompilation is complete!");
 
-            if (logic_stream.is_open()) {
-                InputLines.clear();
-                std::string newline;
-                while (std::getline(logic_stream, newline))
-                    InputLines.append(newline.c_str());
-                logic_stream.close();
-            } else { //source file not found - reading from the game
-                err = logic.decode(ResNum);
-                if (err) {
-                    menu->errmes("Errors in logic.%03d:\n%s", ResNum, logic.ErrorList.c_str());
+    return failed ? 1 : 0;
+}
+
+//*********************************************************
+// One picture of RenderPictures(): the data is read in the calling thread,
+// the picture is rendered and written in a worker thread.
+typedef struct {
+    int ResNum;
+    TCachedData Data;
+    std::string Failed;  // file that couldn't be written
+} TRenderJob;
+
+//*********************************************************
+// Render all pictures of the game into 'outdir': picture.NNN.png and
+// picture.NNN.pri.png get the visual and priority screens as they are shown
+// (MAX_W x MAX_HH) and, if 'raw' is set, picture.NNN.raw and picture.NNN.pri.raw
+// get their colours, one byte per pixel (PIC_W x MAX_HH).
+int Game::RenderPictures(const std::string &outdir, bool raw)
+{
+    std::vector<TRenderJob> jobs;
+    int failed = 0, written = 0;
+
+    for (int ResNum = 0; ResNum < 256; ResNum++) {
+        if (!ResourceInfo[PICTURE][ResNum].Exists)
+            continue;
+        TCachedData data = LoadResourceData(PICTURE, ResNum);
+        if (data)
+            jobs.push_back({ResNum, data, ""});
+        else
+            failed++;
+    }
+
+    // Render on all cores. Each thread has its own BPicture.
+    std::atomic<int> next_job(0);
+    auto render_jobs = [&]() {
+        BPicture picture;
+        int n;
+        while ((n = next_job++) < (int)jobs.size()) {
+            TRenderJob &job = jobs[n];
+            picture.show(job.Data->data(), job.Data->size());
+            auto name = QString("%1/%2.%3").arg(outdir.c_str()).arg(ResTypeName[PICTURE]).arg(QString::number(job.ResNum), 3, '0');
+            for (int pri = 0; pri < 2 && job.Failed.empty(); pri++) {
+                const byte *screen = pri ? picture.priority : picture.picture;
+                QString filename = pri ? name + ".pri" : name;
+                if (!picture_image(screen, BPicture::stride).save(filename + ".png", "PNG")) {
+                    job.Failed = (filename + ".png").toStdString();
                     continue;
                 }
-                InputLines.clear();
-                std::string::size_type pos;
-                std::string str = logic.OutputText;
-                while ((pos = str.find_first_of("\n")) != std::string::npos) {
-                    InputLines.append(str.substr(0, pos).c_str());
-                    str = str.substr(pos + 1);
+                if (!raw)
+                    continue;
+                QFile outfile(filename + ".raw");
+                if (!outfile.open(QIODevice::WriteOnly)) {
+                    job.Failed = (filename + ".raw").toStdString();
+                    continue;
                 }
-                if (str != "")
-                    InputLines.append(str.c_str());
-            }
-            err = logic.compile();
-            if (!err)
-                game->AddResource(LOGIC, ResNum);
-            else {
-                if (!logic.ErrorList.empty())
-                    menu->errmes("Errors in logic.%03d:\n%s", ResNum, logic.ErrorList.c_str());
+                for (int y = 0; y < MAX_HH; y++)
+                    outfile.write(reinterpret_cast<const char *>(screen + y * BPicture::stride), PIC_W);
+                outfile.close();
             }
-            progress.setValue(step++);
-            if (progress.wasCanceled())
-                return 1;
         }
-    }
+    };
 
-    progress.setValue(steps);
-    QMessageBox::information(menu, "AGI studio", "Recompilation is complete!");
+    int num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    num_threads = std::min(num_threads, std::max(1, (int)jobs.size()));
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++)
+        threads.emplace_back(render_jobs);
+    for (auto &thread : threads)
+        thread.join();
+
+    for (const auto &job : jobs) {
+        if (!job.Failed.empty()) {
+            menu->errmes("Can't write file '%s'!", job.Failed.c_str());
+            failed++;
+        } else
+            written++;
+    }
+    menu->infomes("%d pictures rendered to %s", written, outdir.c_str());
 
-    return 0;
+    return failed ? 1 : 0;
 }
@@ -24,6 +24,10 @@
 
 #include <string>
 #include <iosfwd>
+#include <vector>
+
+#include "rescache.h"
+#include "volfile.h"
 
 
 typedef unsigned char byte;
@@ -35,15 +39,42 @@ typedef struct {
 } TResourceInfo ;
 
 #define MaxResourceSize 65530
+#define ResourceCacheSize (16 * 1024 * 1024)  // memory used for cached resources
 
 typedef struct {
     byte *Data;
     int Size;
 } TResource;
 
+// A resource with its own data buffer (see Game::LoadResource).
+// Unlike the global ResourceData, any number of these can exist at once.
+struct AGIResource {
+    int Type = -1;            // LOGIC, PICTURE, VIEW or SOUND
+    int Num = -1;             // resource number
+    std::vector<byte> Data;
+
+    int Size() const
+    {
+        return (int)Data.size();
+    }
+    bool empty() const
+    {
+        return Data.empty();
+    }
+};
+
 
 class QSettings;
 
+// Something that reads resources on another thread (like PreviewPrefetch).
+// The game stops it before its resource tables or VOL files change.
+class BackgroundReader
+{
+public:
+    virtual ~BackgroundReader() { }
+    virtual void stopReading() = 0;  // drop the reads not started yet and wait for the current one
+};
+
 class Game
 {
 public:
@@ -55,11 +86,21 @@ public:
     int close();
     void make_source_dir();
     int GetResourceSize(int ResType, int ResNum) const;
+    AGIResource LoadResource(int ResType, int ResNum, bool report_errors = true) const;
+    TCachedData LoadResourceData(int ResType, int ResNum, bool report_errors = true) const;
+    // for other threads: 'info' and 'v3' are copies of ResourceInfo[ResType][ResNum] and isV3
+    TCachedData LoadResourceData(int ResType, int ResNum, const TResourceInfo &info, bool v3) const;
+    int AddResource(const AGIResource &res);
+    // Compatibility versions of the above, using the global ResourceData buffer
     int ReadResource(int ResourceType, int ResourceID);
     int AddResource(int ResType, int ResNum);
     int DeleteResource(int ResType, int ResNum);
     int RebuildVOLfiles();
     int RecompileAll();
+    int RenderPictures(const std::string &outdir, bool raw);
+    int ExtractResource(const std::string &filename, int ResType, int ResNum, bool LogicAsText);
+    void add_reader(BackgroundReader *reader);
+    void remove_reader(BackgroundReader *reader);
 
     TResourceInfo ResourceInfo[4][256];  //logic, picture, view, sound
     std::string dir;  //game directory
@@ -75,13 +116,24 @@ public:
     //  only object which is guaranteed to exist at the start of the program.
     QSettings *settings;
 
+    // Recently used resources; AddResource() and DeleteResource() keep it up to date.
+    mutable ResourceCache cache;
+
 private:
     long AGIVersionNumber;
     std::string FindAGIV3GameID(const std::string &gamepath) const;
     long GetAGIVersionNumber(void) const;
-    int ReadV3Resource(char ResourceType, int ResourceID);
+    int ViewResource(const TResourceInfo &info, bool v3, TResourceView *view, bool report_errors = true) const;
+    TCachedData ReadResourceData(int ResType, int ResNum, const TResourceInfo &info, bool v3, bool report_errors) const;
+    int ReadV3Resource(const TResourceView &view, int ResType, std::vector<byte> &data) const;
+    byte PackResource(const AGIResource &res, std::vector<byte> &packed) const;
+    int FinishRebuild();
     std::unique_ptr<std::fstream> OpenPatchVol(int PatchVol, int *filesize) const;
     std::unique_ptr<std::fstream> OpenDirUpdate(int *dirsize, int ResType);
+
+    mutable VolFileSet vols;  // VOL files of the current game, mapped on first use
+    std::vector<BackgroundReader *> readers;
+    void stop_readers();
 };
 
 extern Game *game;
@@ -89,7 +141,7 @@ extern Game *game;
 extern const char *ResTypeName[4];
 extern const char *ResTypeAbbrv[4];
 
-extern TResource ResourceData;
+extern TResource ResourceData;  // obsolete shared buffer, use AGIResource instead
 
 extern const char EncryptionKey[];
 
@@ -27,63 +27,31 @@
 #include "logedit.h"
 
 
-extern QStringList InputLines;  //temporary -
-//input text from the editor window or file
-
 static bool UseTypeChecking = true;
-static int ResPos, LogicSize;
-static QStringList EditLines, IncludeFilenames;
-static std::string DefineNames[MaxDefines];
-static std::string DefineValues[MaxDefines];
-static int NumDefines;
-static int  RealLineNum[65535], LineFile[65535];
-static int DefineNameLength[MaxDefines];
-static std::string Messages[MaxMessages];
-static bool MessageExists[MaxMessages];
-
-typedef struct {
-    std::string Name;
-    int Loc;
-} TLogicLabel;
-static TLogicLabel Labels[MaxLabels + 1];
-static int NumLabels;
-
-static bool ErrorOccured;
-static int CurLine;
-static std::string LowerCaseLine, ArgText, LowerCaseArgText;
-static std::string::size_type LinePos, LineLength, ArgTextLength, ArgTextPos;
-static bool FinishedReading;
-static int CommandNameStartPos;
-static std::string CommandName;
-static int CommandNum;
-static bool NOTOn;
-
-char empty_tmp[] = {0};
 
 extern const char EncryptionKey[];
-static int EncryptionStart;
 
 //*************************************************
-static void WriteByte(byte b)
+void Logic::WriteByte(byte b)
 {
-    if (ResPos < ResourceData.Size) {
-        ResourceData.Data[ResPos++] = b;
+    if (ResPos < Resource.Size()) {
+        Resource.Data[ResPos++] = b;
         if (ResPos > LogicSize)
             LogicSize = ResPos;
     }
 }
 
-static void WriteByteAtLoc(byte b, int Loc)
+void Logic::WriteByteAtLoc(byte b, int Loc)
 {
-    if (Loc < ResourceData.Size) {
-        ResourceData.Data[Loc] = b;
+    if (Loc < Resource.Size()) {
+        Resource.Data[Loc] = b;
         if (Loc > LogicSize)
             LogicSize = Loc;
     }
 
 }
 
-static void WriteLSMSWord(short word)
+void Logic::WriteLSMSWord(short word)
 {
     WriteByte(word % 256);
     WriteByte(word / 256);
@@ -92,39 +60,56 @@ static void WriteLSMSWord(short word)
 //*************************************************
 void Logic::ShowError(int Line, std::string ErrorMsg)
 {
-    int LineNum = RealLineNum[Line];
-    if (LineFile[Line] == 0 || Line > EditLines.count()) {
+    TDiagnostic diag = {"", 0, -1, DiagError, DiagCode, ErrorMsg};
+
+    // the column is only known while reading commands, on the current line
+    if (DiagCode == DiagCommand && Line == CurLine)
+        diag.Column = CurColumn;
+    if (Line >= (int)RealLineNum.size())  // past the end of the text: use the last line
+        Line = RealLineNum.size() - 1;
+    diag.Line = (Line >= 0) ? RealLineNum[Line] : 0;
+    if (Line < 0 || LineFile[Line] == 0) {
         // error is in logic in editor window
-        sprintf(tmp, "Line %d: %s\n", RealLineNum[Line], ErrorMsg.c_str());
+        ErrorList.append("Line " + std::to_string(diag.Line) + ": " + ErrorMsg + "\n");
     } else { //error in include file
-        if (LineFile[Line] > IncludeFilenames.count())
-            sprintf(tmp, "[unknown include file] Line ???: %s\n", ErrorMsg.c_str());
-        else
-            sprintf(tmp, "File %s Line %d: %s\n", IncludeFilenames.at(LineFile[Line] - 1).toStdString().c_str(), LineNum, ErrorMsg.c_str());
+        diag.File = IncludeFilenames[LineFile[Line] - 1];
+        ErrorList.append("File " + diag.File + " Line " + std::to_string(diag.Line) + ": " + ErrorMsg + "\n");
     }
+    Diagnostics.push_back(diag);
 
-    ErrorList.append(tmp);
     ErrorOccured = true;
 }
 
 //***************************************************
-std::string Logic::ReadString(std::string::size_type *pos, std::string &str)
+// Returns the position of the quote mark that ends the string starting
+// at pos1 in str, or std::string::npos if there is none
+static std::string::size_type FindStringEnd(const std::string &str, std::string::size_type pos1)
+{
+    std::string::size_type pos2 = pos1;
+
+    do {
+        pos2 = str.find_first_of("\"", pos2 + 1);
+        if (pos2 == std::string::npos)
+            return pos2;
+    } while (str[pos2 - 1] == '\\');
+    return pos2;
+}
+
+//***************************************************
+std::string Logic::ReadString(std::string::size_type *pos, const std::string &str)
 //returns string without quotes, starting from pos1
 //pos is set to the 1st char after string
 {
     std::string::size_type pos1 = *pos;
-    std::string::size_type pos2 = pos1;
+    std::string::size_type pos2 = FindStringEnd(str, pos1);
 
     //  printf ("ReadString: str=%s pos=%d\n",str.c_str(),*pos);
 
-    do {
-        pos2 = str.find_first_of("\"", pos2 + 1);
-        if (pos2 == std::string::npos) {
-            ShowError(CurLine, "\" required at end of string.");
-            printf("string: *%s*\n", str.c_str());
-            return "";
-        }
-    } while (str[pos2 - 1] == '\\');
+    if (pos2 == std::string::npos) {
+        ShowError(CurLine, "\" required at end of string.");
+        printf("string: *%s*\n", str.c_str());
+        return "";
+    }
 
     *pos = pos2 + 1;
     if (pos2 == pos1 + 1)
@@ -134,329 +119,418 @@ std::string Logic::ReadString(std::string::size_type *pos, std::string &str)
 }
 
 //***************************************************
-int Logic::RemoveComments(QStringList &Lines)
+static bool IsWordChar(char c)
 {
-    int CommentDepth = 0;
-    for (CurLine = 0; CurLine < Lines.count(); CurLine++) {
-        std::string Line = Lines.at(CurLine).toStdString();
-        std::string NewLine;
-        bool InQuotes = false;
-        for (unsigned i = 0; i < Line.size(); ++i) {
-            if (!InQuotes) {
-                if (CommentDepth == 0 && Line[i] == '[')
-                    break;
-                if (i < Line.size() - 1) {
-                    if (CommentDepth == 0 && Line.substr(i, 2) == "//")
-                        break;
-                    else if (Line.substr(i, 2) == "/*") {
-                        ++CommentDepth;
-                        ++i;
-                        continue;
-                    }
-                } else if (CommentDepth > 0 && Line.substr(i, 2) == "*/") {
-                    --CommentDepth;
-                    ++i;
-                    continue;
-                }
-            }
-            if (CommentDepth == 0) {
-                if (Line[i] == '\"' && (i == 0 || Line[i - 1] != '\\'))
-                    InQuotes = !InQuotes;
-                NewLine += Line[i];
-            }
-        }
-        Lines.replace(CurLine, NewLine.c_str());
-    }
-    return 0;
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' || c == '_';
 }
 
 //***************************************************
-int Logic::AddIncludes()
+// Splits source line 'Line' (number LineNum in its file) into tokens, which
+// are added to Tokens. Comments are left out: "//" and "[" end the line,
+// and CommentDepth carries the (nested) "/* */" comments to the next line.
+static void Tokenize(const std::string &Line, int LineNum, int &CommentDepth, std::vector<TLogicToken> &Tokens)
 {
-    QStringList IncludeStrings, IncludeLines;
-    int  CurInputLine, CurIncludeLine;
-    std::string filename;
-    int err = 0;
-    std::string::size_type pos1, pos2;
-    int CurLine;
-    char *ptr;
-
-    IncludeFilenames = QStringList();
-    IncludeStrings = QStringList();
-    EditLines = QStringList();
-    IncludeLines = QStringList();
-    CurLine = 0;
-    for (CurInputLine = 0; CurInputLine < InputLines.count(); CurInputLine++) {
-        EditLines.append(InputLines.at(CurInputLine));
-        CurLine = EditLines.count() - 1;
-        RealLineNum[CurLine] = CurInputLine;
-        LineFile[CurLine] = 0;
-
-        if (!InputLines.at(CurInputLine).startsWith("#include", Qt::CaseInsensitive))
-            continue;
-        std::string str = InputLines.at(CurInputLine).sliced(8).toStdString();
-        if (str.length() < 4) {
-            ShowError(CurLine, "Missing include filename !");
-            err = 1;
-            continue;
-        }
-        if (str[0] != ' ') {
-            ShowError(CurLine, "' ' expected after #include.");
-            err = 1;
-            continue;
-        }
-        pos1 = str.find_first_of("\"", 1);
-        pos2 = str.find_first_of("\"", pos1 + 1);
-        if (pos1 == std::string::npos || pos2 == std::string::npos) {
-            ShowError(CurLine, "Include filenames need quote marks around them.");
-            err = 1;
+    static const char *Operators[] = {"==", "!=", "<=", ">=", "+=", "-=", "*=", "/=", "++", "--", "&&", "||"};
+    std::string::size_type i = 0, len = Line.length();
+    int col = 0;  // column of Line[i]
+
+    // moves on n bytes, counting the UTF-8 characters
+    auto skip = [&](std::string::size_type n) {
+        for (std::string::size_type end = std::min(i + n, len); i < end; i++)
+            if ((Line[i] & 0xC0) != 0x80)
+                col++;
+    };
+
+    while (i < len) {
+        char c = Line[i];
+        if (CommentDepth > 0) {
+            if (Line.compare(i, 2, "*/") == 0) {
+                CommentDepth--;
+                skip(2);
+            } else if (Line.compare(i, 2, "/*") == 0) {
+                CommentDepth++;
+                skip(2);
+            } else
+                skip(1);
             continue;
         }
-        filename = str.substr(pos1 + 1, pos2 - pos1 - 1);
-        if (filename.find_first_of("/") != std::string::npos) {
-            ShowError(CurLine, "Only files in the src directory can be included.");
-            err = 1;
+        if (c == ' ' || c == '\t' || c == '\r') {
+            skip(1);
             continue;
         }
-        sprintf(tmp, "%s/src/%s", game->dir.c_str(), filename.c_str());
-        FILE *fptr = fopen(tmp, "rb");
-        if (fptr == NULL) {
-            sprintf(tmp, "Can't open include file: %s/src/%s", game->dir.c_str(), filename.c_str());
-            ShowError(CurLine, tmp);
-            err = 1;
+        if (c == '[' || Line.compare(i, 2, "//") == 0)
+            break;
+        if (Line.compare(i, 2, "/*") == 0) {
+            CommentDepth++;
+            skip(2);
             continue;
         }
-        IncludeLines.clear();
-
-        while (fgets(tmp, MAX_TMP, fptr) != NULL) {
-            if ((ptr = strchr(tmp, 0x0a)))
-                * ptr = 0;
-            if ((ptr = strchr(tmp, 0x0d)))
-                * ptr = 0;
-            IncludeLines.append(tmp);
-        }
-        fclose(fptr);
-        if (IncludeLines.count() == 0)
-            continue;
-        IncludeFilenames.append(filename.c_str());
-        RemoveComments(IncludeLines);
-        EditLines.replace(CurLine, empty_tmp);
-        for (CurIncludeLine = 0; CurIncludeLine < IncludeLines.count(); CurIncludeLine++) {
-            EditLines.append(IncludeLines.at(CurIncludeLine));
-            CurLine = EditLines.count() - 1;
-            RealLineNum[CurLine] = CurIncludeLine;
-            LineFile[CurLine] = IncludeFilenames.count();
+
+        TLogicToken Token;
+        std::string::size_type start = i;
+        Token.Line = LineNum;
+        Token.Column = col;
+        if (IsWordChar(c) || (c == '#' && i == 0)) {
+            Token.Type = (c == '#') ? TokDirective : TokWord;
+            do
+                skip(1);
+            while (i < len && IsWordChar(Line[i]));
+            Token.Text = Line.substr(start, i - start);
+            std::transform(Token.Text.begin(), Token.Text.end(), Token.Text.begin(), ::tolower);
+        } else if (c == '"') {
+            std::string::size_type end = FindStringEnd(Line, i);
+            if (end == std::string::npos) {
+                Token.Type = TokBadString;
+                Token.Text = Line.substr(i + 1);
+                skip(len - i);
+            } else {
+                Token.Type = TokString;
+                Token.Text = Line.substr(i + 1, end - i - 1);
+                skip(end + 1 - i);
+            }
+        } else {
+            Token.Type = TokSymbol;
+            std::string::size_type n = 1;
+            for (const char *op : Operators) {
+                if (Line.compare(i, 2, op) == 0) {
+                    n = 2;
+                    break;
+                }
+            }
+            while (i + n < len && (Line[i + n] & 0xC0) == 0x80)  // the whole UTF-8 character
+                n++;
+            Token.Text = Line.substr(i, n);
+            skip(n);
         }
+        Token.EndColumn = col;
+        Tokens.push_back(std::move(Token));
     }
+}
 
-    IncludeLines.clear();
-    InputLines.clear();
-    return err;
+//***************************************************
+// true if token i+1 follows token i with no space in between
+static bool Adjacent(const std::vector<TLogicToken> &Tokens, size_t i)
+{
+    return i + 1 < Tokens.size() && Tokens[i + 1].Line == Tokens[i].Line && Tokens[i + 1].Column == Tokens[i].EndColumn;
 }
 
 //***************************************************
-int Logic::ReadDefines()
+// Parses a #define line: the tokens from First (the directive) to the end
+// of Tokens. The checks that need the other defines are left to
+// Logic::AddDefine().
+static void ParseDefine(const std::vector<TLogicToken> &Tokens, size_t First, TDefineLine &Define)
 {
-    int err = 0, i;
-    std::string::size_type pos1, pos2;
-    std::string ThisDefineName, ThisDefineValue;
-    int CurLine;
-
-    NumDefines = 0;
-    for (CurLine = 0; CurLine < EditLines.count(); CurLine++) {
-        if (!EditLines.at(CurLine).startsWith("#define", Qt::CaseInsensitive))
-            continue;
-        std::string str = EditLines.at(CurLine).sliced(7).toStdString();
-        std::transform(str.begin(), str.end(), str.begin(), ::tolower);
-        if (str.length() < 4) {
-            ShowError(CurLine, "Missing define name !");
-            err = 1;
-            continue;
-        }
-        if (str[0] != ' ') {
-            ShowError(CurLine, "' ' expected after #define.");
-            err = 1;
-            continue;
-        }
-        if (NumDefines >= MaxDefines) {
-            ShowError(CurLine, "Too many defines (max " + std::to_string(MaxDefines) + ")");
-            err = 1;
-            continue;
-        }
-        pos1 = str.find_first_not_of(" ", 1);
-        pos2 = str.find_first_of(" ", pos1);
-        if (pos1 == std::string::npos || pos2 == std::string::npos) {
-            ShowError(CurLine, "Missing define name !");
-            err = 1;
-            continue;
-        }
-        ThisDefineName = str.substr(pos1, pos2 - 1);
-        if (ThisDefineName.find_first_not_of("qwertyuiopasdfghjklzxcvbnm1234567890._") != std::string::npos) {
-            ShowError(CurLine, "Define name can contain only characters from [a-z],'.' and '_'.");
-            err = 1;
-            continue;
-        }
-        for (i = 0; i < NumDefines; i++) {
-            if (ThisDefineName == DefineNames[i]) {
-                ShowError(CurLine, ThisDefineName + " already defined !");
-                err = 1;
-                break;
-            }
-        }
-        if (err)
-            continue;
+    size_t name = First + 1, value = First + 2;
 
-        for (i = 0; i <= NumAGICommands; i++) {
-            if (ThisDefineName == AGICommand[i].Name) {
-                ShowError(CurLine, "Define name can not be a command name.");
-                err = 1;
-                break;
-            }
-        }
-        if (err)
-            continue;
+    Define.Name = Define.Value = Define.Error = "";
+    if (name >= Tokens.size()) {
+        Define.Error = "Missing define name !";
+        return;
+    }
+    if (Adjacent(Tokens, First)) {
+        Define.Error = "' ' expected after #define.";
+        return;
+    }
+    if (Tokens[name].Type != TokWord || Adjacent(Tokens, name)) {
+        Define.Error = "Define name can contain only characters from [a-z],'.' and '_'.";
+        return;
+    }
+    Define.Name = Tokens[name].Text;
+    if (FindAGICommand(Define.Name) >= 0 || FindTestCommand(Define.Name) >= 0) {
+        Define.Error = "Define name can not be a command name.";
+        return;
+    }
+    if (Define.Name == "if" || Define.Name == "else" || Define.Name == "goto") {
+        Define.Error = "Invalid define name (" + Define.Name + ")";
+        return;
+    }
+
+    if (value >= Tokens.size()) {
+        Define.Error = "Missing define value !";
+        return;
+    }
+    if (Tokens[value].Type == TokString) {
+        Define.Value = "\"" + Tokens[value].Text + "\"";
+        std::transform(Define.Value.begin(), Define.Value.end(), Define.Value.begin(), ::tolower);
+    } else if (Tokens[value].Type == TokBadString) {
+        Define.Error = "\" required at end of string.";
+        return;
+    } else if (Tokens[value].Type != TokWord || Adjacent(Tokens, value)) {
+        Define.Error = "Non-string define value can contain only characters from [a-z],'.' and '_'.";
+        return;
+    } else
+        Define.Value = Tokens[value].Text;
+    if (value + 1 < Tokens.size())
+        Define.Error = "Nothing allowed on line after define value.";
+}
+
+//***************************************************
+// Parses a #message line: the tokens from First (the directive) to the
+// end of Tokens
+static void ParseMessage(const std::vector<TLogicToken> &Tokens, size_t First, TMessageLine &Message)
+{
+    size_t num = First + 1, text = First + 2;
+
+    Message.Num = 0;
+    Message.Text = Message.Error = "";
+    if (num >= Tokens.size() || Adjacent(Tokens, First)) {
+        Message.Error = "' ' expected after #message.";
+        return;
+    }
+    if (Tokens[num].Type == TokWord)
+        Message.Num = atoi(Tokens[num].Text.c_str());
+    if (Message.Num < 1 || Message.Num >= MaxMessages) {
+        Message.Error = "Invalid message number (must be 1-255).";
+        return;
+    }
+    if (text >= Tokens.size() || (Tokens[text].Type != TokString && Tokens[text].Type != TokBadString)) {
+        Message.Error = "\" required at start of string.";
+        return;
+    }
+    if (Tokens[text].Type == TokBadString) {
+        Message.Error = "\" required at end of string.";
+        return;
+    }
+    Message.Text = Tokens[text].Text;
+    if (text + 1 < Tokens.size())
+        Message.Error = "Nothing allowed on line after message. ";
+}
 
-        for (i = 1; i <= NumTestCommands; i++) {
-            if (ThisDefineName == TestCommand[i].Name) {
-                ShowError(CurLine, "Define name can not be a command name.");
-                err = 1;
-                break;
+//***************************************************
+// Reads and tokenizes an include file. Its #define and #message lines are
+// parsed and left out of the tokens. Returns nullptr if the file can't
+// be opened.
+static std::shared_ptr<TIncludeFile> ReadIncludeFile(const std::string &path)
+{
+    char *ptr;
+    char line[MAX_TMP];
+    int CommentDepth = 0;
+
+    FILE *fptr = fopen(path.c_str(), "rb");
+    if (fptr == NULL)
+        return nullptr;
+    auto file = std::make_shared<TIncludeFile>();
+    file->NumLines = 0;
+    while (fgets(line, MAX_TMP, fptr) != NULL) {
+        if ((ptr = strchr(line, 0x0a)))
+            * ptr = 0;
+        if ((ptr = strchr(line, 0x0d)))
+            * ptr = 0;
+        size_t First = file->Tokens.size();
+        Tokenize(line, file->NumLines, CommentDepth, file->Tokens);
+        if (First < file->Tokens.size() && file->Tokens[First].Type == TokDirective) {
+            if (file->Tokens[First].Text == "#define") {
+                file->Defines.emplace_back();
+                file->Defines.back().Line = file->NumLines;
+                ParseDefine(file->Tokens, First, file->Defines.back());
+                file->Tokens.resize(First);
+            } else if (file->Tokens[First].Text == "#message") {
+                file->Messages.emplace_back();
+                file->Messages.back().Line = file->NumLines;
+                ParseMessage(file->Tokens, First, file->Messages.back());
+                file->Tokens.resize(First);
             }
         }
-        if (err)
-            continue;
+        file->NumLines++;
+    }
+    fclose(fptr);
 
-        if (ThisDefineName == "if" || ThisDefineName == "else" || ThisDefineName == "goto") {
-            ShowError(CurLine, "Invalid define name (" + ThisDefineName + ")");
-            err = 1;
-            continue;
-        }
+    return file;
+}
 
-        pos1 = str.find_first_not_of(" ", pos2 + 1);
-        if (pos1 == std::string::npos) {
-            ShowError(CurLine, "Missing define value !");
-            err = 1;
-            continue;
-        }
-        if (str[pos1] == '"') {
-            ThisDefineValue = "\"" + ReadString(&pos1, str) + "\"";
-            if (ErrorOccured)
-                continue;
-            if (str.find_first_not_of(" ", pos1) != std::string::npos) {
-                ShowError(CurLine, "Nothing allowed on line after define value.");
-                err = 1;
-                continue;
-            }
+//***************************************************
+std::shared_ptr<const TIncludeFile> IncludeCache::get(const std::string &path)
+{
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(path, ec);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iter = files.find(path);
+    if (!ec && iter != files.end() && iter->second.first == mtime)
+        return iter->second.second;
+    std::shared_ptr<const TIncludeFile> file = ReadIncludeFile(path);
+    if (file && !ec)
+        files[path] = {mtime, file};
+    return file;
+}
+
+//***************************************************
+// Adds the include file named by the #include line at Tokens[First] (the
+// directive and its tokens are removed), with its defines and messages
+int Logic::AddInclude(size_t First)
+{
+    int err = 0;
+
+    DiagCode = DiagInclude;
+    bool spaced = !Adjacent(Tokens, First);
+    TLogicToken Name;
+    if (First + 1 < Tokens.size())
+        Name = Tokens[First + 1];
+    else
+        Name.Type = TokWord;
+    Tokens.resize(First);
+    if (Name.Type == TokString && Name.Text == "") {
+        ShowError(CurLine, "Missing include filename !");
+        return 1;
+    }
+    if (!spaced) {
+        ShowError(CurLine, "' ' expected after #include.");
+        return 1;
+    }
+    if (Name.Type != TokString) {
+        ShowError(CurLine, (Name.Text == "") ? "Missing include filename !" : "Include filenames need quote marks around them.");
+        return 1;
+    }
+    std::string filename = Name.Text;
+    if (filename.find_first_of("/") != std::string::npos) {
+        ShowError(CurLine, "Only files in the src directory can be included.");
+        return 1;
+    }
+    std::string path = game->dir + "/src/" + filename;
+    std::shared_ptr<const TIncludeFile> file = includecache ? includecache->get(path) : ReadIncludeFile(path);
+    if (!file) {
+        ShowError(CurLine, "Can't open include file: " + path);
+        return 1;
+    }
+    IncludedFiles.append(filename.c_str());
+    if (file->NumLines == 0)
+        return 0;
+    IncludeFilenames.push_back(filename);
+    int Start = RealLineNum.size();
+    for (int CurIncludeLine = 0; CurIncludeLine < file->NumLines; CurIncludeLine++) {
+        RealLineNum.push_back(CurIncludeLine);
+        LineFile.push_back(IncludeFilenames.size());
+    }
+    for (const auto &Token : file->Tokens) {
+        Tokens.push_back(Token);
+        Tokens.back().Line += Start;
+    }
+
+    // its defines and messages have been parsed already: add them in the
+    // order of their lines
+    size_t d = 0, m = 0;
+    while (d < file->Defines.size() || m < file->Messages.size()) {
+        if (m == file->Messages.size() || (d < file->Defines.size() && file->Defines[d].Line < file->Messages[m].Line)) {
+            CurLine = Start + file->Defines[d].Line;
+            DiagCode = DiagDefine;
+            err |= AddDefine(file->Defines[d++]);
         } else {
-            pos2 = str.find_first_of(" ", pos1 + 1);
-            if (pos2 == std::string::npos)
-                ThisDefineValue = str.substr(pos1);
-            else {
-                ThisDefineValue = str.substr(pos1, pos2 - pos1);
-                if (str.find_first_not_of(" ", pos2) != std::string::npos) {
-                    ShowError(CurLine, "Nothing allowed on line after define value.");
-                    err = 1;
-                    continue;
-                }
-            }
-            if (ThisDefineValue.find_first_not_of("qwertyuiopasdfghjklzxcvbnm1234567890._") != std::string::npos) {
-                ShowError(CurLine, "Non-string define value can contain only characters from [a-z],'.' and '_'.");
-                err = 1;
-                continue;
-            }
+            CurLine = Start + file->Messages[m].Line;
+            DiagCode = DiagMessage;
+            err |= AddPredefinedMessage(file->Messages[m++]);
         }
+    }
+    return err;
+}
 
-        DefineNames[NumDefines] = ThisDefineName;
-        DefineValues[NumDefines] = ThisDefineValue;
-        DefineNameLength[NumDefines] = ThisDefineName.length();
-        NumDefines++;
-        EditLines.replace(CurLine, empty_tmp);
+//***************************************************
+// Adds a parsed #define (from line CurLine) to the defines
+int Logic::AddDefine(const TDefineLine &Define)
+{
+    if (Define.Error != "") {
+        ShowError(CurLine, Define.Error);
+        return 1;
+    }
+    if (DefineNum.count(Define.Name)) {
+        ShowError(CurLine, Define.Name + " already defined !");
+        return 1;
     }
 
-    return err;
+    DefineNum[Define.Name] = DefineNames.size();
+    DefineNames.push_back(Define.Name);
+    DefineValues.push_back(Define.Value);
+    return 0;
 }
 
 //***************************************************
-int Logic::ReadPredefinedMessages()
+// Adds a parsed #message (from line CurLine) to the messages
+int Logic::AddPredefinedMessage(const TMessageLine &Message)
 {
-    int err = 0, i;
-    std::string::size_type pos1;
-    int MessageNum;
+    if (Message.Error != "") {
+        ShowError(CurLine, Message.Error);
+        return 1;
+    }
+    Messages[Message.Num] = Message.Text;
+    MessageExists[Message.Num] = true;
+    return 0;
+}
+
+//***************************************************
+// Tokenizes InputLines into Tokens, in one walk that also reads the
+// #include, #define and #message lines. The include files are tokenized
+// in place of their #include lines.
+int Logic::ReadDirectives()
+{
+    TDefineLine Define;
+    TMessageLine Message;
+    int CommentDepth = 0;
+    int err = 0;
 
-    for (i = 0; i < MaxMessages; i++) {
+    Tokens.clear();
+    IncludeFilenames.clear();
+    IncludedFiles = QStringList();
+    RealLineNum.clear();
+    LineFile.clear();
+    DefineNames.clear();
+    DefineValues.clear();
+    DefineNum.clear();
+    for (int i = 0; i < MaxMessages; i++) {
         Messages[i] = "";
         MessageExists[i] = false;
     }
-    for (CurLine = 0; CurLine < EditLines.count(); CurLine++) {
-        if (!EditLines.at(CurLine).startsWith("#message", Qt::CaseInsensitive))
-            continue;
-        std::string str = EditLines.at(CurLine).sliced(8).toStdString();
-        if (str[0] != ' ') {
-            ShowError(CurLine, "' ' expected after #message.");
-            err = 1;
-            continue;
-        }
-        MessageNum = atoi(str.c_str());
-        if (MessageNum == 0) {
-            ShowError(CurLine, "Invalid message number (must be 1-255).");
-            err = 1;
+    for (int CurInputLine = 0; CurInputLine < InputLines.count(); CurInputLine++) {
+        CurLine = RealLineNum.size();
+        RealLineNum.push_back(CurInputLine);
+        LineFile.push_back(0);
+
+        size_t First = Tokens.size();
+        Tokenize(InputLines.at(CurInputLine).toStdString(), CurLine, CommentDepth, Tokens);
+        if (First == Tokens.size() || Tokens[First].Type != TokDirective)
             continue;
+        if (Tokens[First].Text == "#include")
+            err |= AddInclude(First);
+        else if (Tokens[First].Text == "#define") {
+            DiagCode = DiagDefine;
+            ParseDefine(Tokens, First, Define);
+            Tokens.resize(First);
+            err |= AddDefine(Define);
+        } else if (Tokens[First].Text == "#message") {
+            DiagCode = DiagMessage;
+            ParseMessage(Tokens, First, Message);
+            Tokens.resize(First);
+            err |= AddPredefinedMessage(Message);
         }
-        pos1 = str.find_first_of("\"");
-        if (pos1 == std::string::npos) {
-            ShowError(CurLine, "\" required at start of string.");
-            err = 1;
-            continue;
-        }
-        Messages[MessageNum] = ReadString(&pos1, str);
-        if (ErrorOccured)
-            continue;
-        if (Messages[MessageNum].find_first_not_of(" ", pos1) != std::string::npos) {
-            sprintf(tmp, "Nothing allowed on line after message. ");
-            ShowError(CurLine, tmp);
-            err = 1;
-            continue;
-        }
-        MessageExists[MessageNum] = true;
-        EditLines.replace(CurLine, empty_tmp);
     }
+    InputLines.clear();
 
     return err;
+}
 
+//***************************************************
+// true if Tokens[Token] is a label: a word at the start of a line,
+// followed by ':'
+bool Logic::LabelAt(size_t Token) const
+{
+    return Tokens[Token].Type == TokWord
+           && (Token == 0 || Tokens[Token - 1].Line != Tokens[Token].Line)
+           && Adjacent(Tokens, Token) && Tokens[Token + 1].Text == ":";
 }
 
 //***************************************************
 int Logic::ReadLabels()
 {
-    int err = 0, i;
-    std::string::size_type pos1, pos2;
-    std::string LabelName;
-    int CurLine;
+    int err = 0;
 
+    Labels.assign(1, TLogicLabel());
+    LabelNums.clear();
     NumLabels = 0;
-    for (CurLine = 0; CurLine < EditLines.count(); CurLine++) {
-        std::string str = EditLines.at(CurLine).toStdString();
-        std::transform(str.begin(), str.end(), str.begin(), ::tolower);
-        pos1 = str.find_first_not_of(" ");
-        if (pos1 == std::string::npos)
-            continue;
-        pos2 = str.find_first_not_of("qwertyuiopasdfghjklzxcvbnm1234567890._", pos1);
-        if (pos2 == std::string::npos)
-            continue;
-        if ((pos1 == pos2) || (str[pos2] != ':'))
-            continue;
-        LabelName = str.substr(pos1, pos2 - pos1);
-        for (i = 1; i <= NumLabels; i++) {
-            if (LabelName == Labels[i].Name) {
-                ShowError(CurLine, "Label " + LabelName + " already defined.");
-                err = 1;
-                break;
-            }
-        }
-        if (err)
+    for (size_t i = 0; i < Tokens.size(); i++) {
+        if (!LabelAt(i))
             continue;
-        if (NumLabels > MaxLabels) {
-            ShowError(CurLine, "Too many labels (max " + std::to_string(MaxLabels) + ")");
+        const std::string &LabelName = Tokens[i].Text;
+        CurLine = Tokens[i].Line;
+        if (LabelNums.count(LabelName)) {
+            ShowError(CurLine, "Label " + LabelName + " already defined.");
             err = 1;
             continue;
         }
@@ -465,52 +539,43 @@ int Logic::ReadLabels()
             err = 1;
             continue;
         }
-        for (i = 0; i < NumDefines; i++) {
-            if ((LabelName == DefineNames[i]) || (LabelName + ":" == DefineNames[i])) {
-                ShowError(CurLine, "Can't have a label with the same name a a define.");
-                err = 1;
-                break;
-            }
-        }
-        if (err)
+        if (DefineNum.count(LabelName) || DefineNum.count(LabelName + ":")) {
+            ShowError(CurLine, "Can't have a label with the same name a a define.");
+            err = 1;
             continue;
+        }
         NumLabels++;
-        Labels[NumLabels].Name = LabelName;
-        Labels[NumLabels].Loc = 0;
+        Labels.push_back({LabelName, 0});
+        LabelNums[LabelName] = NumLabels;
     }
 
     return err;
 }
 
 //***************************************************
-void Logic::NextLine()
+void Logic::ReadToken()
 {
-    int NumLines = EditLines.count();
+    CurLine = Tokens[CurToken].Line;
+    CurColumn = Tokens[CurToken].EndColumn;
+    CurToken++;
+}
 
-    CurLine++;
-    if (CurLine >= NumLines) {
-        FinishedReading = true;
-        return;
-    }
-    do {
-        LowerCaseLine = EditLines.at(CurLine).toStdString();
-        if (LowerCaseLine == empty_tmp || (LinePos = LowerCaseLine.find_first_not_of(" ")) == std::string::npos) {
-            CurLine++;
-            continue;
-        }
-        std::transform(LowerCaseLine.begin(), LowerCaseLine.end(), LowerCaseLine.begin(), ::tolower);
-        LineLength = LowerCaseLine.length();
-        return;
-    } while (CurLine < NumLines);
-    FinishedReading = true;
+//***************************************************
+// true if the next token is the word or symbol Text
+bool Logic::NextTokenIs(const char *Text) const
+{
+    return CurToken < Tokens.size() && (Tokens[CurToken].Type == TokWord || Tokens[CurToken].Type == TokSymbol)
+           && Tokens[CurToken].Text == Text;
 }
 
 //***************************************************
-void Logic::SkipSpaces()
+// Reads the next token if it is the word or symbol Text
+bool Logic::ReadTokenIf(const char *Text)
 {
-    LinePos = LowerCaseLine.find_first_not_of(" ", LinePos);
-    if (LinePos == std::string::npos)
-        NextLine();
+    if (!NextTokenIs(Text))
+        return false;
+    ReadToken();
+    return true;
 }
 
 //***************************************************
@@ -541,52 +606,31 @@ byte Logic::AddMessage(std::string TheMessage)
 }
 
 //***************************************************
-static std::string TrimEndWhitespaces(const std::string &str)
+std::string Logic::ReplaceDefine(const std::string &InText)
 {
-    int i = str.length();
-    while (i > 0 && (str[i - 1] == ' ' || str[i - 1] == '\t'))
-        --i;
-    return str.substr(0, i);
-}
-
-//***************************************************
-std::string Logic::ReplaceDefine(std::string InText)
-{
-    std::string str = InText;
-    std::transform(str.begin(), str.end(), str.begin(), ::tolower);
-    for (int i = 0; i < NumDefines; i++) {
-        if (str == DefineNames[i])
-            return DefineValues[i];
-    }
-    return InText;
+    auto iter = DefineNum.find(InText);
+    return (iter != DefineNum.end()) ? DefineValues[iter->second] : InText;
 }
 
 //***************************************************
+// Reads an argument: a word (or what it is defined as) or a string, which
+// is kept in quote marks
 void Logic::ReadArgText()
-// do not use for string - does not take quotes into account
 {
-    std::string::size_type pos1, pos2;
-
-    SkipSpaces();
-    pos1 = pos2 = LinePos;
-
-    if (LowerCaseLine[pos1] == '"') {
-        ArgText = "\"" + ReadString(&pos2, LowerCaseLine) + "\"";
-        pos2 = LowerCaseLine.find_first_of(",)", pos2);
-    } else
-        pos2 = LowerCaseLine.find_first_of(",)", pos1);
-    if (pos2 == std::string::npos) {
-        LinePos = LineLength;
-        ArgText = ReplaceDefine(TrimEndWhitespaces(
-                                    EditLines.at(CurLine).right(pos1).toStdString()));
-    } else {
-        LinePos = pos2;
-        ArgText = ReplaceDefine(TrimEndWhitespaces(
-                                    EditLines.at(CurLine).mid(pos1, pos2 - pos1).toStdString()));
+    ArgText = "";
+    if (CurToken < Tokens.size()) {
+        const TLogicToken &Token = Tokens[CurToken];
+        if (Token.Type == TokWord) {
+            ArgText = ReplaceDefine(Token.Text);
+            ReadToken();
+        } else if (Token.Type == TokString) {
+            ArgText = "\"" + Token.Text + "\"";
+            ReadToken();
+        } else if (Token.Type == TokBadString) {
+            ReadToken();
+            ShowError(CurLine, "\" required at end of string.");
+        }
     }
-
-    LowerCaseArgText = ArgText;
-    std::transform(LowerCaseArgText.begin(), LowerCaseArgText.end(), LowerCaseArgText.begin(), ::tolower);
     ArgTextLength = ArgText.length();
     ArgTextPos = 0;
 }
@@ -595,8 +639,7 @@ void Logic::ReadArgText()
 int Logic::ReadArgValue()
 {
     char *ptr;
-    std::string str2 = ArgText.substr(ArgTextPos);
-    const char *str = str2.c_str();
+    const char *str = ArgText.c_str() + ArgTextPos;
     long val = strtol(str, &ptr, 10);
     ArgTextPos += (int)(ptr - str);
     if ((val == 0 && ptr == str) || val == LONG_MIN || val == LONG_MAX)
@@ -638,33 +681,29 @@ void Logic::ReadArgs(bool CommandIsIf, byte CmdNum)
     int ThisInvObjectNum;
     int i;
 
-    SkipSpaces();
-    if (LinePos >= LineLength || EditLines.at(CurLine)[LinePos] != '(') {
+    if (!ReadTokenIf("(")) {
         ShowError(CurLine, "'(' expected.");
         return;
     }
-    LinePos++;
     if (CmdNum == 14 && CommandIsIf) { //said test command
         NumSaidArgs = -1;
         FinishedReadingSaidArgs = false;
         do {
             ReadArgText();
+            if (ErrorOccured)
+                return;
             NumSaidArgs++;
             if (ArgText[0] == '"') {
                 ArgValue = 0;
                 ArgTextPos = 0;
                 ThisWord = ReadString(&ArgTextPos, ArgText);
-                if (ErrorOccured)
-                    ShowError(CurLine, "\" required at end of word.");
+                // Find word group number
+                int groupnum = wordlist->GroupNumOfWord(ThisWord);
+                if (groupnum != -1)
+                    ArgValue = groupnum;
                 else {
-                    // Find word group number
-                    int groupnum = wordlist->GroupNumOfWord(ThisWord);
-                    if (groupnum != -1)
-                        ArgValue = groupnum;
-                    else {
-                        ShowError(CurLine, "Unknown word " + ThisWord + ".");
-                        return;
-                    }
+                    ShowError(CurLine, "Unknown word " + ThisWord + ".");
+                    return;
                 }
             } else
                 ArgValue = ReadArgValue();
@@ -673,17 +712,16 @@ void Logic::ReadArgs(bool CommandIsIf, byte CmdNum)
                 ShowError(CurLine, "Invalid word number for argument " + std::to_string(NumSaidArgs) + " (must be 0-65535).");
                 SaidArgs[NumSaidArgs] = 0;
             }
-            if ((LinePos < LineLength) && (LowerCaseLine[LinePos] == ',')) {
-                if (NumSaidArgs > MaxSaidArgs) {
+            if (ReadTokenIf(",")) {
+                if (NumSaidArgs + 1 >= MaxSaidArgs) {
                     ShowError(CurLine, "Too many arguments for said command.");
                     FinishedReadingSaidArgs = true;
                 }
-            } else if (LinePos < LineLength && LowerCaseLine[LinePos] == ')')
+            } else if (ReadTokenIf(")"))
                 FinishedReadingSaidArgs = true;
             else
                 ShowError(CurLine, "',' or ')' expected after argument " + std::to_string(NumSaidArgs) + ".");
-            LinePos++;
-        } while (!FinishedReadingSaidArgs || ErrorOccured);
+        } while (!FinishedReadingSaidArgs && !ErrorOccured);
         WriteByte(NumSaidArgs + 1);
         for (int i = 0; i <= NumSaidArgs; i++) {
             WriteByte(SaidArgs[i] % 256);
@@ -696,23 +734,21 @@ void Logic::ReadArgs(bool CommandIsIf, byte CmdNum)
         else
             ThisCommand = AGICommand[CmdNum];
         for (CurArg = 0; CurArg < ThisCommand.NumArgs; CurArg++) {
-            SkipSpaces();
             ReadArgText();
+            if (ErrorOccured)
+                return;
             if (ThisCommand.argTypes[CurArg] == atMsg && ArgTextLength >= 1 && ArgText[0] == '"') {
                 // argument is message and given as string
                 ArgTextPos = 0;
                 ThisMessage = "";
-                //splitting the message into lines if it doesn't fit the screen
+                //the message can go on in strings on the next lines
                 do {
                     if (ThisMessage != "" && ThisMessage[ThisMessage.length() - 1] != ' ')
                         ThisMessage += " ";
                     ThisMessage += ReadString(&ArgTextPos, ArgText);
-                    if (LinePos + 1 >= LineLength || LowerCaseLine.find_first_not_of(" ", LinePos + 1) == std::string::npos) {
-
-                        NextLine();
-                        SkipSpaces();
+                    if (CurToken < Tokens.size() && Tokens[CurToken].Type == TokString && Tokens[CurToken].Line > CurLine)
                         ReadArgText();
-                    } else
+                    else
                         break;
                 } while (true);
                 ThisMessageNum = MessageNum(ThisMessage);
@@ -746,13 +782,13 @@ void Logic::ReadArgs(bool CommandIsIf, byte CmdNum)
             }// argument is inventory object and given as string
             else { //normal argument
                 ThisArgTypePrefix = (char *)ArgTypePrefix[(int)ThisCommand.argTypes[CurArg]];
-                if (UseTypeChecking && (strcmp(LowerCaseArgText.substr(0, strlen(ThisArgTypePrefix)).c_str(), ThisArgTypePrefix)))
+                if (UseTypeChecking && ArgText.compare(0, strlen(ThisArgTypePrefix), ThisArgTypePrefix) != 0)
                     ShowError(CurLine, "Invalid or unknown argument type for argument " + std::to_string(CurArg) + " (should be a " + ArgTypeName[(int)ThisCommand.argTypes[CurArg]] + ").");
                 else {
                     if (UseTypeChecking)
                         ArgTextPos += strlen(ThisArgTypePrefix);
                     else
-                        while (ArgTextPos < ArgTextLength && !(LowerCaseArgText[ArgTextPos] >= 'a' && LowerCaseArgText[ArgTextPos] <= 'z'))
+                        while (ArgTextPos < ArgTextLength && !(ArgText[ArgTextPos] >= 'a' && ArgText[ArgTextPos] <= 'z'))
                             ArgTextPos++;
                     ArgValue = ReadArgValue();
                     if (ArgValue < 0 || ArgValue > 255)
@@ -762,115 +798,68 @@ void Logic::ReadArgs(bool CommandIsIf, byte CmdNum)
                 }
             }//normal argument
             if (CurArg < ThisCommand.NumArgs - 1) {
-                if (ArgTextPos < ArgTextLength)
-                    ShowError(CurLine, "',' expected after argument " + std::to_string(CurArg) + ".");
-                else if (LinePos >= LineLength || LowerCaseLine[LinePos] != ',')
+                if (ArgTextPos < ArgTextLength || !ReadTokenIf(","))
                     ShowError(CurLine, "',' expected after argument " + std::to_string(CurArg) + ".");
-                else
-                    LinePos++;
-            } else if (ArgTextPos < ArgTextLength) {
+            } else if (ArgTextPos < ArgTextLength)
                 ShowError(CurLine, "(1) ')' expected after argument " + std::to_string(CurArg) + ".");
-                printf("Line %s argtextpos=%d arglen=%d\n", LowerCaseLine.c_str(), (int)ArgTextPos, (int)ArgTextLength);
-            }
+            if (ErrorOccured)
+                return;
         }
-        SkipSpaces();
-        if (LinePos >= LineLength || LowerCaseLine[LinePos] != ')') {
-
-            if (ThisCommand.NumArgs > 0) {
+        if (!ReadTokenIf(")")) {
+            if (ThisCommand.NumArgs > 0)
                 ShowError(CurLine, "(2) ')' expected after argument " + std::to_string(ThisCommand.NumArgs) + ".");
-                printf("Line %s argtextpos=%d arglen=%d\n", LowerCaseLine.c_str(), (int)ArgTextPos, (int)ArgTextLength);
-            } else
+            else
                 ShowError(CurLine, "')' expected.");
-        } else
-            LinePos++;
-    }
-}
-
-//***************************************************
-std::string Logic::ReadText()
-{
-    int p = LinePos;
-    std::string::size_type pos = LowerCaseLine.find_first_of("( ,):", LinePos);
-    if (pos == std::string::npos) {
-        LinePos = LineLength;
-        return LowerCaseLine.substr(p);
-    } else {
-        LinePos = pos;
-        return LowerCaseLine.substr(p, pos - p);
+        }
     }
 }
 
 //***************************************************
+// Reads the next token if it is a word
 std::string Logic::ReadPlainText()
 {
-    int p = LinePos;
-    std::string::size_type pos = LowerCaseLine.find_first_not_of("qwertyuiopasdfghjklzxcvbnm1234567890._", LinePos);
-
-    if (pos == std::string::npos) {
-        LinePos = LineLength;
-        return LowerCaseLine.substr(p);
-    } else {
-        LinePos = pos;
-        return LowerCaseLine.substr(p, pos - p);
-    }
+    if (CurToken >= Tokens.size() || Tokens[CurToken].Type != TokWord)
+        return "";
+    ReadToken();
+    return Tokens[CurToken - 1].Text;
 }
 
 //***************************************************
+// Reads the next token if it is an operator
 std::string Logic::ReadExprText()
 {
-    int p = LinePos;
-    std::string::size_type pos = LowerCaseLine.find_first_not_of("=+-*/><!", LinePos);
-    if (pos == std::string::npos) {
-        LinePos = LineLength;
-        return LowerCaseLine.substr(p);
-    } else {
-        LinePos = pos;
-        return LowerCaseLine.substr(p, pos - p);
-    }
+    if (CurToken >= Tokens.size() || Tokens[CurToken].Type != TokSymbol
+            || Tokens[CurToken].Text.find_first_not_of("=+-*/><!") != std::string::npos)
+        return "";
+    ReadToken();
+    return Tokens[CurToken - 1].Text;
 }
 
 //***************************************************
 void Logic::ReadCommandName()
 {
-    SkipSpaces();
-    CommandNameStartPos = LinePos;
-    CommandName = ReadText();
+    CommandName = "";
+    if (CurToken < Tokens.size()) {
+        CommandName = Tokens[CurToken].Text;
+        ReadToken();
+    }
 }
 
 //***************************************************
 byte Logic::FindCommandNum(bool CommandIsIf, std::string CmdName)
 {
-    int i;
-    const char *s;
-
-    s = CmdName.c_str();
-
-    if (CommandIsIf) {
-        for (i = 1; i <= NumTestCommands; i++) {
-            if (!strcmp(s, TestCommand[i].Name))
-                return i;
-        }
-        return 255;
-    } else {
-        for (i = 0; i <= NumAGICommands; i++) {
-            if (!strcmp(s, AGICommand[i].Name))
-                return i;
-        }
-        return 255;
-    }
+    int num = CommandIsIf ? FindTestCommand(CmdName) : FindAGICommand(CmdName);
+    return (num < 0) ? 255 : num;
 }
 
 //***************************************************
 bool Logic::AddSpecialIFSyntax()
 {
-    int OldLinePos;
     int arg1, arg2;
     bool arg2isvar, AddNOT;
     std::string ArgText, expr;
 
-    OldLinePos = LinePos;
-    LinePos -= CommandName.length();
-    ArgText = ReplaceDefine(ReadPlainText());
+    ArgText = ReplaceDefine(CommandName);
 
     if (ArgText[0] == 'v') {
         if (NOTOn)
@@ -879,9 +868,7 @@ bool Logic::AddSpecialIFSyntax()
         if (arg1 < 0 || arg1 > 255)
             ShowError(CurLine, "Invalid number given or error in expression syntax.");
         else {
-            SkipSpaces();
             expr = ReadExprText();
-            SkipSpaces();
             ArgText = ReplaceDefine(ReadPlainText());
             arg2isvar = (ArgText[0] == 'v');
             if (arg2isvar)
@@ -933,8 +920,6 @@ bool Logic::AddSpecialIFSyntax()
             return true;
         }
     }//if(ArgText[0]=='f')
-    else
-        LinePos = OldLinePos;
     return false;
 }
 
@@ -944,15 +929,11 @@ bool Logic::AddSpecialSyntax()
     int arg1, arg2, arg3;
     bool arg2isvar = false, arg3isvar = false, arg2isstar = false;
     std::string ArgText = "", expr, expr2;
-    int OldLinePos;
 
-    OldLinePos = LinePos;
-    LinePos -= CommandName.length();
-    if (CommandName[0] == '*') {
-        LinePos++;
+    if (CommandName == "*")
         ArgText = "*" + ReplaceDefine(ReadPlainText());
-    } else
-        ArgText = ReplaceDefine(ReadPlainText());
+    else
+        ArgText = ReplaceDefine(CommandName);
 
     if (ArgText[0] == 'v') {
 
@@ -960,7 +941,6 @@ bool Logic::AddSpecialSyntax()
         if (arg1 < 0 || arg1 > 255)
             ShowError(CurLine, "Invalid number given or error in expression syntax.");
         else {
-            SkipSpaces();
             expr = ReadExprText();
             if (expr == "++") {
                 WriteByte(0x01); // increment
@@ -971,18 +951,11 @@ bool Logic::AddSpecialSyntax()
                 WriteByte(arg1);
                 return true;
             } else {
-                if (expr[0] == '*') {
-                    expr = expr.substr(1);
-                    LinePos++;
-                }
-                SkipSpaces();
                 arg2isstar = false;
-                ArgText = ReadPlainText();
-                if (ReadPlainText() == "" && LowerCaseLine[LinePos - ArgText.length()] == '*') {
-                    LinePos++;
+                if (ReadTokenIf("*"))
                     ArgText = "*" + ReplaceDefine(ReadPlainText());
-                } else
-                    ArgText = ReplaceDefine(ArgText);
+                else
+                    ArgText = ReplaceDefine(ReadPlainText());
 
                 if (ArgText[0] == 'v' && !arg2isstar)
                     arg2isvar = true;
@@ -1032,7 +1005,7 @@ bool Logic::AddSpecialSyntax()
                         WriteByte(arg2);
                         return true;
                     } else if (expr == "=") {
-                        if (LinePos < LineLength && EditLines.at(CurLine)[LinePos] == ';') {
+                        if (NextTokenIs(";")) {
                             //must be assignn, assignv or rindirect
                             if (arg2isvar)
                                 WriteByte(0x04); // assignv
@@ -1043,12 +1016,10 @@ bool Logic::AddSpecialSyntax()
                             WriteByte(arg1);
                             WriteByte(arg2);
                             return true;
-                        } else if (arg2 != arg1)
+                        } else if (!arg2isvar || arg2 != arg1)
                             ShowError(CurLine, "Expression syntax error");
                         else {
-                            SkipSpaces();
                             expr2 = ReadExprText();
-                            SkipSpaces();
                             ArgText = ReplaceDefine(ReadPlainText());
                             arg3isvar = (ArgText[0] == 'v');
                             if (arg3isvar)
@@ -1102,18 +1073,14 @@ bool Logic::AddSpecialSyntax()
         }//if(arg1<0 || arg1>255)
     }//if(ArgText[0]=='v')
     else if (ArgText.substr(0, 2) == "*v") {
-        LinePos -= (CommandName.length() - 1);
-        ArgText = ReplaceDefine(ReadPlainText());
-        arg1 = Val(ArgText.substr(1));
+        arg1 = Val(ArgText.substr(2));
         if (arg1 < 0 || arg1 > 255)
             ShowError(CurLine, "Invalid number given or error in expression syntax.");
         else {
-            SkipSpaces();
             expr = ReadExprText();
             if (expr != "=")
                 ShowError(CurLine, "Expression syntax error");
             else {
-                SkipSpaces();
                 ArgText = ReplaceDefine(ReadPlainText());
                 arg2isvar = (ArgText[0] == 'v');
                 if (arg2isvar)
@@ -1134,32 +1101,18 @@ bool Logic::AddSpecialSyntax()
             }
         }
     }//if(ArgText.substr(0,2)=="*v")
-    else
-        LinePos = OldLinePos;
     return false;
 }
 
 //***************************************************
 int Logic::LabelNum(std::string LabelName)
 {
-    for (int i = 1; i <= NumLabels; i++) {
-        if (Labels[i].Name == LabelName)
-            return i;
-    }
-    return 0;
-}
-
-//***************************************************
-bool Logic::LabelAtStartOfLine(std::string LabelName)
-{
-    std::string::size_type pos = LinePos - LabelName.length() - 1;
-    if (LowerCaseLine.find_first_not_of(" ") < pos)
-        return false;
-    return true;
+    auto iter = LabelNums.find(LabelName);
+    return (iter != LabelNums.end()) ? iter->second : 0;
 }
 
 //***************************************************
-void WriteEncByte(byte TheByte)
+void Logic::WriteEncByte(byte TheByte)
 {
     WriteByte(TheByte ^ EncryptionKey[(ResPos - EncryptionStart) % 11]) ;
 }
@@ -1226,28 +1179,25 @@ int Logic::CompileCommands()
     int NumCommandsInIfStatement = 0, NumCommandsInIfBrackets = 0;
 
     typedef struct {
-        byte LabelNum;
+        int LabelNum;
         int DataLoc;
     } TLogicGoto;
-    TLogicGoto Gotos[MaxGotos + 1];
-    short NumGotos, GotoData, CurGoto;
+    std::vector<TLogicGoto> Gotos;
+    short GotoData;
 
     memset(BlockIsIf, 0, sizeof(BlockIsIf));
     InIf = false;
     BlockDepth = 0;
-    NumGotos = 0;
-    FinishedReading = false;
-    CurLine = -1;
-    NextLine();
-    if (FinishedReading) {
-        ShowError(CurLine, "Nothing to compile !");
+    CurToken = 0;
+    CurLine = CurColumn = 0;
+    if (Tokens.empty()) {
+        ShowError(RealLineNum.size(), "Nothing to compile !");
         return 1;
     }
     do {
         LastCommandWasReturn = false;
         if (!InIf) {
-            if (LinePos < LineLength && LowerCaseLine[LinePos] == '}') {
-                LinePos++;
+            if (ReadTokenIf("}")) {
                 if (BlockDepth == 0)
                     ShowError(CurLine, "'}' not at end of any command blocks.");
                 else {
@@ -1257,20 +1207,14 @@ int Logic::CompileCommands()
                     WriteByteAtLoc(BlockLength[BlockDepth] & 0xff, BlockStartDataLoc[BlockDepth]);
                     WriteByteAtLoc((BlockLength[BlockDepth] >> 8) & 0xff, BlockStartDataLoc[BlockDepth] + 1);
                     BlockDepth--;
-                    SkipSpaces();
-                    if (LinePos >= LineLength && CurLine < EditLines.count() - 1)
-                        NextLine();
-                    if (LowerCaseLine.substr(LinePos, 4) == "else") {
-                        LinePos += 4;
-                        SkipSpaces();
+                    if (ReadTokenIf("else")) {
                         if (! BlockIsIf[BlockDepth + 1])
                             ShowError(CurLine, "'else' not allowed after command blocks that start with 'else'.");
 
-                        else if (LinePos >= LineLength || LowerCaseLine[LinePos] != '{')
+                        else if (!ReadTokenIf("{"))
                             ShowError(CurLine, "'{' expected after else.");
 
                         else {
-                            LinePos++;
                             BlockDepth++;
                             BlockLength[BlockDepth] += 3;
                             WriteByteAtLoc(BlockLength[BlockDepth] & 0xff, BlockStartDataLoc[BlockDepth]);
@@ -1281,19 +1225,17 @@ int Logic::CompileCommands()
                             WriteByte(0x00);  // block length filled in later.
                             WriteByte(0x00);
                         }
-                    }//if(LowerCaseLine.substr(LinePos,4) == "else"
+                    }//if else
                 }//if BlockDepth > 0
-            }//if LowerCaseLine[LinePos] == '}'
+            }//if '}'
             else {
                 ReadCommandName();
                 if (CommandName == "if") {
                     WriteByte(0xFF);
                     InIf = true;
-                    SkipSpaces();
-                    if (LinePos >= LineLength || EditLines.at(CurLine)[LinePos] != '(')
+                    if (!ReadTokenIf("("))
                         ShowError(CurLine, "'(' expected at start of if statement.");
 
-                    LinePos++;
                     InIfBrackets = false;
                     NumCommandsInIfStatement = 0;
                     AwaitingNextTestCommand = true;
@@ -1301,93 +1243,72 @@ int Logic::CompileCommands()
                     ShowError(CurLine, "'}' required before 'else'.");
 
                 else if (CommandName == "goto") {
-                    if (LinePos >= LineLength || LowerCaseLine[LinePos] != '(')
+                    if (!ReadTokenIf("("))
                         ShowError(CurLine, "'(' expected.");
                     else {
-                        LinePos++;
                         ReadCommandName();
                         CommandName = ReplaceDefine(CommandName);
                         if (LabelNum(CommandName) == 0)
                             ShowError(CurLine, "Unknown label " + CommandName + ".");
-                        else if (NumGotos >= MaxGotos)
-                            ShowError(CurLine, "Too many labels (max " + std::to_string(MaxLabels) + ").");
                         else {
-                            NumGotos++;
-                            Gotos[NumGotos].LabelNum = LabelNum(CommandName);
                             WriteByte(0xFE);
-                            Gotos[NumGotos].DataLoc = ResPos;
+                            Gotos.push_back({LabelNum(CommandName), ResPos});
                             WriteByte(0x00);
                             WriteByte(0x00);
-                            if (LinePos >= LineLength || LowerCaseLine[LinePos] != ')')
+                            if (!ReadTokenIf(")"))
                                 ShowError(CurLine, "')' expected after label name.");
-
-                            LinePos++;
-                            if (LinePos >= LineLength || LowerCaseLine[LinePos] != ';')
+                            else if (!ReadTokenIf(";"))
                                 ShowError(CurLine, "';' expected after goto command.");
-                            LinePos++;
                         }
                     }
                 } else {
                     CommandNum = FindCommandNum(false, CommandName);
-                    EncounteredLabel = (LabelNum(CommandName) > 0);
-                    if (EncounteredLabel && LinePos < LineLength && LowerCaseLine[LinePos] == ':')
-                        LinePos++;
-                    else
-                        EncounteredLabel = false;
-                    EncounteredLabel = (EncounteredLabel && LabelAtStartOfLine(CommandName));
-                    if (EncounteredLabel)
+                    EncounteredLabel = (LabelNum(CommandName) > 0 && LabelAt(CurToken - 1));
+                    if (EncounteredLabel) {
+                        ReadToken();  // ':'
                         Labels[LabelNum(CommandName)].Loc = ResPos;
-                    else {
+                    } else {
                         if (CommandNum == 255) { // not found
                             if (!AddSpecialSyntax())
-                                ShowError(CurLine, "Unknown action command " + EditLines.at(CurLine).mid(CommandNameStartPos, CommandName.length()).toStdString() + ".");
+                                ShowError(CurLine, "Unknown action command " + CommandName + ".");
                         } else {
                             WriteByte(CommandNum);
                             ReadArgs(false, CommandNum);
                             if (CommandNum == 0)
                                 LastCommandWasReturn = true;
                         }
-                        if (LinePos >= LineLength || EditLines.at(CurLine)[LinePos] != ';')
+                        if (!ErrorOccured && !ReadTokenIf(";"))
                             ShowError(CurLine, "';' expected after command.");
-
-                        LinePos++;
                     }//if we found a label
                 }//command
-            }//if LowerCaseLine[LinePos] != '}'
+            }//if not '}'
         }//(!InIf)
         if (InIf) {
             LastCommandWasReturn = false;
             if (AwaitingNextTestCommand) {
-                if (LowerCaseLine[LinePos] == '(') {
+                if (ReadTokenIf("(")) {
                     if (InIfBrackets)
                         ShowError(CurLine, "Brackets too deep in if statement.");
                     InIfBrackets = true;
                     WriteByte(0xFC);
                     NumCommandsInIfBrackets = 0;
-                    LinePos++;
-                }// if LowerCaseLine[LinePos] = '('
-                else if (LowerCaseLine[LinePos] == ')') {
+                }// if '('
+                else if (ReadTokenIf(")")) {
                     if (NumCommandsInIfStatement == 0)
                         ShowError(CurLine, "If statement must contain at least one command.");
                     else if (InIfBrackets && (NumCommandsInIfBrackets == 0))
                         ShowError(CurLine, "Brackets must contain at least one command.");
                     else
                         ShowError(CurLine, "Expected statement but found closing bracket.");
-                    LinePos++;
                 } else {
-                    NOTOn = false;
-                    if (LowerCaseLine[LinePos] == '!') {
-                        NOTOn = true;
-                        LinePos++;
-                    }
-                    SkipSpaces();
+                    NOTOn = ReadTokenIf("!");
                     ReadCommandName();
                     CommandNum = FindCommandNum(true, CommandName);
                     if (NOTOn)
                         WriteByte(0xFD);
                     if (CommandNum == 255) { // not found
                         if (!AddSpecialIFSyntax())
-                            ShowError(CurLine, "Unknown test command " + EditLines.at(CurLine).mid(CommandNameStartPos, CommandName.length()).toStdString() + ".");
+                            ShowError(CurLine, "Unknown test command " + CommandName + ".");
                     } else {
                         WriteByte(CommandNum);
                         ReadArgs(true, CommandNum);
@@ -1398,9 +1319,8 @@ int Logic::CompileCommands()
                     AwaitingNextTestCommand = false;
                 }
             }  // if AwaitingNextTestCommand
-            else if (LinePos < LineLength) {
-                if (LowerCaseLine[LinePos] == ')') {
-                    LinePos++;
+            else if (CurToken < Tokens.size()) {
+                if (ReadTokenIf(")")) {
                     if (InIfBrackets) {
                         if (NumCommandsInIfBrackets == 0)
                             ShowError(CurLine, "Brackets must contain at least one command.");
@@ -1411,10 +1331,8 @@ int Logic::CompileCommands()
                         if (NumCommandsInIfStatement == 0)
                             ShowError(CurLine, "If statement must contain at least one command.");
                         else {
-                            SkipSpaces();
-                            if (LinePos > LineLength || EditLines.at(CurLine)[LinePos] != '{')
+                            if (!ReadTokenIf("{"))
                                 ShowError(CurLine, "'{' expected after if statement.");
-                            LinePos++;
                             WriteByte(0xFF);
                             if (BlockDepth > MaxBlockDepth)
                                 ShowError(CurLine, "Too many nested blocks (max " + std::to_string(MaxBlockDepth) + ").");
@@ -1428,33 +1346,26 @@ int Logic::CompileCommands()
                             InIf = false;
                         }
                     }
-                } // else if LowerCaseLine[LinePos] == ')'
-                else if (LowerCaseLine[LinePos] == '!') {
+                } // else if ')'
+                else if (ReadTokenIf("!"))
                     ShowError(CurLine, "'!' can only be placed directly in front of a command.");
-                    LinePos++;
-                } else if (LowerCaseLine.substr(LinePos, 2) == "&&") {
+                else if (ReadTokenIf("&&")) {
                     if (InIfBrackets)
                         ShowError(CurLine, "'&&' not allowed within brackets.");
                     AwaitingNextTestCommand = true;
-                    LinePos += 2;
-                } else if (LowerCaseLine.substr(LinePos, 2) == "||") {
+                } else if (ReadTokenIf("||")) {
                     if (!InIfBrackets)
                         ShowError(CurLine, "Commands to be ORred together must be placed within brackets.");
                     AwaitingNextTestCommand = true;
-                    LinePos += 2;
                 } else {
                     if (InIfBrackets)
                         ShowError(CurLine, "Expected '||' or end of if statement.");
                     else
                         ShowError(CurLine, "Expected '&&' or end of if statement.");
                 }
-            }// if (not AwaitingNextTestCommand) and (LinePos < LineLength)
+            }// if (not AwaitingNextTestCommand) and there are tokens left
         }//if InIf
-        SkipSpaces();
-        if (ErrorOccured)
-            FinishedReading = true;
-        else if (LinePos >= LineLength)
-            NextLine();
+        FinishedReading = (ErrorOccured || CurToken >= Tokens.size());
     } while (!FinishedReading);
     if (!LastCommandWasReturn)
         ShowError(CurLine, "return command expected.");
@@ -1472,78 +1383,55 @@ int Logic::CompileCommands()
         }
     } else if (BlockDepth > 0)
         ShowError(CurLine, "'}' expected.");
-    for (CurGoto = 1; CurGoto <= NumGotos; CurGoto++) {
-        GotoData = Labels[Gotos[CurGoto].LabelNum].Loc - Gotos[CurGoto].DataLoc - 2;
-        WriteByteAtLoc((GotoData & 0xff), Gotos[CurGoto].DataLoc);
-        WriteByteAtLoc((GotoData >> 8) & 0xff, Gotos[CurGoto].DataLoc + 1);
+    for (const auto &Goto : Gotos) {
+        GotoData = Labels[Goto.LabelNum].Loc - Goto.DataLoc - 2;
+        WriteByteAtLoc((GotoData & 0xff), Goto.DataLoc);
+        WriteByteAtLoc((GotoData >> 8) & 0xff, Goto.DataLoc + 1);
     }
 
     return err;
 }
 
 //***************************************************
-int Logic::compile()
+// Compiles InputLines into Resource. If 'lists_read' is set, the words and
+// objects already in wordlist/objlist are used instead of reading the files.
+int Logic::compile(bool lists_read)
 {
-    int ret, i, j;
-
-    sprintf(tmp, "%s/words.tok", game->dir.c_str());
-    ret = wordlist->read(tmp);
-    if (ret)
+    if (!lists_read && ReadLists())
         return 1;
 
-    sprintf(tmp, "%s/object", game->dir.c_str());
-    ret = objlist->read(tmp, false);
-    if (ret)
-        return 1;
-
-    for (auto iter = objlist->ItemNames.begin(); iter < objlist->ItemNames.end(); iter++)
-        *iter = iter->toLower();
-
-    // words already in lower case in file so we don't need to convert them
-    for (i = 0; i < objlist->ItemNames.count(); i++) {
-        if (!objlist->ItemNames.at(i).contains("\""))
-            continue;
-        //replace " with \"
-        auto str = objlist->ItemNames.at(i).toStdString();
-        char *ptr = (char *)str.c_str();
-        for (j = 0; *ptr; ptr++) {
-            if (*ptr == '"') {
-                tmp[j++] = '\\';
-                tmp[j++] = '"';
-            } else
-                tmp[j++] = *ptr;
-        }
-        tmp[j] = 0;
-        objlist->ItemNames.replace(i, tmp);
-    }
-
-    ResourceData.Size = MaxResourceSize;
+    Resource.Type = LOGIC;
+    Resource.Data.assign(MaxResourceSize, 0);
     LogicSize = 0;
     ResPos = 2;
     ErrorOccured = false;
-    NumDefines = 0;
+    DefineNames.clear();
+    DefineValues.clear();
+    DefineNum.clear();
     ErrorList = "";
+    Diagnostics.clear();
 
-    if (RemoveComments(InputLines))
-        return 1;
-    if (AddIncludes())
-        return 1;
-    if (ReadDefines())
-        return 1;
-    if (ReadPredefinedMessages())
-        return 1;
-    if (ReadLabels())
+    // The directive and label passes go on after errors, so that all
+    // their errors are reported. The commands are only read if they were
+    // all right: otherwise a missing define would give an error at every
+    // line that uses it.
+    int err = 0;
+    err |= ReadDirectives();
+    DiagCode = DiagLabel;
+    err |= ReadLabels();
+    if (err)
         return 1;
+    DiagCode = DiagCommand;
     if (CompileCommands())
         return 1;
 
     WriteMessageSection();
 
-    EditLines.clear();
+    Tokens.clear();
 
     if (ErrorOccured)
         return 1;
     //   printf("\n************* SUCCESS !!! ***********\n");
-    ResourceData.Size = LogicSize;
+    Resource.Data.resize(LogicSize);
     return 0;
 }
@@ -26,50 +26,20 @@
 #include "logedit.h"
 
 
-static int EncryptionStart;
-static int MessageSectionStart, MessageSectionEnd;
-static bool MessageUsed[256], MessageExists[256];
-static int ResPos;
-static byte CurByte;
-static int NumMessages;
-
-static std::string Messages[MaxMessages];
-
-static byte ThisCommand;
 bool ShowArgTypes = true;
 bool ShowNonExistingValues = true;  // Uses the number of an object, word or message instead of the text if it does not exist
 byte SpecialSyntaxType = 1;  // 0 for v30 = v30 + 4;, 1 for v30 += 4;
 
-static byte  BlockDepth;
-static short BlockEnd[MaxBlockDepth + 1];
-static short BlockLength[MaxBlockDepth + 1];
-static bool BlockIsIf[MaxBlockDepth + 1];
-static short TempBlockLength, CurBlock;
-static byte CurArg;
-static unsigned int ArgsStart;
-
-static TResource LabelIndex;
-static int LabelLoc, NumLabels;
-static bool DoGoto;
-static std::string ThisLine;
-
-static bool ErrorOccured;
-
-static bool  FirstCommand, OROn,  NOTOn;
-static byte NumSaidArgs;
-
-static byte IndentPos;
-
 //***************************************************
-static byte ReadByte(void)
+byte Logic::ReadByte(void)
 {
-    if (ResPos < ResourceData.Size)
-        return ResourceData.Data[ResPos++];
+    if (ResPos < Resource.Size())
+        return Resource.Data[ResPos++];
     return 0;
 }
 
 //***************************************************
-static short ReadLSMSWord(void)
+short Logic::ReadLSMSWord(void)
 {
     byte MSbyte, LSbyte;
 
@@ -80,7 +50,7 @@ static short ReadLSMSWord(void)
 }
 
 //***************************************************
-static byte ReadEncByte(void)
+byte Logic::ReadEncByte(void)
 {
     return (ReadByte() ^ EncryptionKey[(ResPos - EncryptionStart + 10) % 11]) ;
 }
@@ -113,7 +83,7 @@ void Logic::ReadMessages(void)
                 ResPos = MessageSectionStart + MessageStart[i] + 1;
                 do {
                     CurByte = ReadEncByte();
-                    if (CurByte == 0 || ResPos >= ResourceData.Size)
+                    if (CurByte == 0 || ResPos >= Resource.Size())
                         break;
                     if (CurByte == 0x0a)
                         ThisMessage += "\\n";
@@ -212,8 +182,7 @@ void Logic::AddBlockEnds(void)
 //***************************************************
 int Logic::FindLabels(void)
 {
-    LabelIndex.Size = ResourceData.Size;
-    LabelIndex.Data = (byte *)calloc(LabelIndex.Size, 1);
+    LabelIndex.assign(Resource.Size(), 0);
     BlockDepth = 0;
     NumLabels = 0;
     do {
@@ -243,15 +212,15 @@ int Logic::FindLabels(void)
             //goto
             if (DoGoto) {
                 LabelLoc = TempBlockLength + ResPos;
-                if (LabelLoc > LabelIndex.Size - 1) {
-                    sprintf(tmp, "Label past end of logic (%x %x)\n ", LabelLoc, LabelIndex.Size);
+                if (LabelLoc > (int)LabelIndex.size() - 1) {
+                    sprintf(tmp, "Label past end of logic (%x %x)\n ", LabelLoc, (int)LabelIndex.size());
                     ErrorList.append(tmp);
                     ErrorOccured = true;
                     break;
                 }
-                if (LabelIndex.Data[LabelLoc] == 0) {
+                if (LabelIndex[LabelLoc] == 0) {
                     NumLabels++;
-                    LabelIndex.Data[LabelLoc] = NumLabels;
+                    LabelIndex[LabelLoc] = NumLabels;
                 }
             }
         } else {
@@ -577,48 +546,19 @@ void Logic::ReadIfs(void)
 //***************************************************
 int Logic::decode(int ResNum)
 {
-    int ret = 0, i, j;
-
     OutputText = "";
-    sprintf(tmp, "%s/words.tok", game->dir.c_str());
-    ret = wordlist->read(tmp);
-    if (ret)
-        return 1;
-
-    sprintf(tmp, "%s/object", game->dir.c_str());
-    ret = objlist->read(tmp, false);
-    if (ret)
+    if (ReadLists())
         return 1;
 
-    for (auto iter = objlist->ItemNames.begin(); iter < objlist->ItemNames.end(); iter++)
-        *iter = iter->toLower();
-    // words already in lower case in file so we don't need to convert them
-    for (i = 0; i < objlist->ItemNames.count(); i++) {
-        if (!objlist->ItemNames.at(i).contains("\""))
-            continue;
-        //replace " with \"
-        auto str = objlist->ItemNames.at(i).toStdString();
-        char *ptr = (char *)str.c_str();
-        for (j = 0; *ptr; ptr++) {
-            if (*ptr == '"') {
-                tmp[j++] = '\\';
-                tmp[j++] = '"';
-            } else
-                tmp[j++] = *ptr;
-        }
-        tmp[j] = 0;
-        objlist->ItemNames.replace(i, tmp);
-    }
-
-    ret = game->ReadResource(LOGIC, ResNum);
-    if (ret)
+    Resource = game->LoadResource(LOGIC, ResNum);
+    if (Resource.empty())
         return 1;
 
     ErrorList = "";
     ResPos = 0;
     MessageSectionStart = ReadLSMSWord() + 2;
 
-    if (MessageSectionStart > ResourceData.Size - 1) {
+    if (MessageSectionStart > Resource.Size() - 1) {
         sprintf(tmp, "Error: Message section start %x is beyond end of resource\n",
                 MessageSectionStart);
         ErrorList.append(tmp);
@@ -635,8 +575,8 @@ int Logic::decode(int ResNum)
     ResPos = 2;
     do {
         AddBlockEnds();
-        if (LabelIndex.Data[ResPos] > 0)
-            OutputText.append("Label" + std::to_string(LabelIndex.Data[ResPos]) + ":\n");
+        if (LabelIndex[ResPos] > 0)
+            OutputText.append("Label" + std::to_string(LabelIndex[ResPos]) + ":\n");
         CurByte = ReadByte();
         if (CurByte == 0xFF)
             ReadIfs();
@@ -678,13 +618,13 @@ int Logic::decode(int ResNum)
             // goto
             if (DoGoto) {
                 LabelLoc = TempBlockLength + ResPos;
-                if (LabelLoc > LabelIndex.Size - 1) {
-                    sprintf(tmp, "Label past end of logic (%x %x)\n ", LabelLoc, LabelIndex.Size);
+                if (LabelLoc > (int)LabelIndex.size() - 1) {
+                    sprintf(tmp, "Label past end of logic (%x %x)\n ", LabelLoc, (int)LabelIndex.size());
                     ErrorList.append(tmp);
                     ErrorOccured = true;
                     break;
                 } else
-                    OutputText.append(QString("  ").repeated(BlockDepth).toStdString() + "goto(Label" + std::to_string(LabelIndex.Data[LabelLoc]) + ");\n");
+                    OutputText.append(QString("  ").repeated(BlockDepth).toStdString() + "goto(Label" + std::to_string(LabelIndex[LabelLoc]) + ");\n");
             }
         } else {
             sprintf(tmp, "Unknown action command (%d)\n", CurByte);
@@ -695,7 +635,7 @@ int Logic::decode(int ResNum)
     } while (ResPos < MessageSectionStart);
     if (!ErrorOccured)
         AddBlockEnds();
-    free(LabelIndex.Data);
+    LabelIndex.clear();
     OutputText.append("\n");
     DisplayMessages();
     return (ErrorOccured) ? 1 : 0;
@@ -28,6 +28,7 @@
 #include <QMessageBox>
 #include <QRegularExpression>
 #include <QSyntaxHighlighter>
+#include <QTextBlock>
 
 #include "agicommands.h"
 #include "game.h"
@@ -37,9 +38,6 @@
 #include "roomgen.h"
 
 
-QStringList InputLines;     // Temporary buffer for reading the text from editor
-                            //  and sending to compilation.
-
 //***********************************************
 // Syntax highlight
 
@@ -178,6 +176,17 @@ private:
     QTextCharFormat multiLineCommentFormat;
 };
 
+//***********************************************
+// Moves the cursor of 'editor' to a line and column (from 0) of its text.
+// A column of -1 is the start of the line.
+static void move_cursor(QTextEdit *editor, int line, int column)
+{
+    QTextCursor cursor(editor->document()->findBlockByNumber(line));
+    if (column > 0)
+        cursor.movePosition(QTextCursor::Right, QTextCursor::MoveAnchor, column);
+    editor->setTextCursor(cursor);
+}
+
 //***********************************************
 LogEdit::LogEdit(QWidget *parent, const char *name, int win_num, ResourcesWin *res, bool readonly)
     : QMainWindow(parent), findedit(nullptr), roomgen(nullptr), winnum(win_num), resources_win(res),
@@ -444,14 +453,14 @@ int LogEdit::compile_logic()
 {
     int err, i;
 
-    InputLines.clear();
+    logic->InputLines.clear();
     for (i = 0; i < textEditor->document()->lineCount(); i++) {
         QString str = textEditor->document()->findBlockByLineNumber(i).text();
         if (!str.isNull() && str.length() > 0) {
             if (str.at(0) < QChar(0x80)) //i'm getting \221\005 at the last line...
-                InputLines.append(str);
+                logic->InputLines.append(str);
         } else
-            InputLines.append("");
+            logic->InputLines.append("");
     }
 
     for (i = 0; i < MAXWIN; i++) {
@@ -468,12 +477,13 @@ int LogEdit::compile_logic()
     if (!err) {
         statusBar()->showMessage("Compiled OK!");
         if (LogicNum != -1) {
-            game->AddResource(LOGIC, LogicNum);
+            logic->Resource.Num = LogicNum;
+            game->AddResource(logic->Resource);
             save_logic();
             changed = false;
         }
     } else {
-        if (!logic->ErrorList.empty()) {
+        if (!logic->Diagnostics.empty()) {
             std::string logic_name;
             if (LogicNum != -1) {
                 std::stringstream ss;
@@ -482,41 +492,33 @@ int LogEdit::compile_logic()
             } else
                 logic_name = "logic";
 
-            if (logic->ErrorList.starts_with("File ")) {
-                // Capture Filename, Line Number, and Error Message
-                QRegularExpression re(R"(File ([\w\d.]+) Line ([\d]+): (.+))");
-                QRegularExpressionMatch match = re.match(logic->ErrorList.c_str());
-
-                std::string error_filename = match.capturedTexts()[0].toStdString();
+            // show where the first error is
+            const TDiagnostic &diag = logic->Diagnostics.front();
+            if (diag.File != "") {
                 for (i = 0; i < MAXWIN; i++) {
                     if (winlist[i].type == TEXTRES) {
                         std::string window_file = QFileInfo(winlist[i].w.t->filename.c_str()).fileName().toStdString();
-                        if (window_file == error_filename) {
-                            winlist[i].w.t->setPosition(match.capturedTexts()[1].toInt());
-                            winlist[i].w.t->statusBar()->showMessage(match.capturedTexts()[2]);
+                        if (window_file == diag.File)
                             break;
-                        }
                     }
                 }
                 if (i >= MAXWIN) {
-                    auto fullname = game->srcdir + "/" + logic_name;
                     for (i = 0; i < MAXWIN; i++) {
                         if (winlist[i].type == -1) {
                             winlist[i].w.t = new TextEdit(nullptr, nullptr, i);
                             winlist[i].type = TEXTRES;
-                            winlist[i].w.t->open(fullname);
-                            winlist[i].w.t->setPosition(match.capturedTexts()[1].toInt());
-                            winlist[i].w.t->statusBar()->showMessage(match.capturedTexts()[2]);
+                            winlist[i].w.t->open(game->dir + "/src/" + diag.File);
                             break;
                         }
                     }
                 }
+                if (i < MAXWIN) {
+                    winlist[i].w.t->setPosition(diag.Line, diag.Column);
+                    winlist[i].w.t->statusBar()->showMessage(diag.Message.c_str());
+                }
             } else {
-                // Capture Line Number and Error Message
-                QRegularExpression re(R"(Line ([\d]+): (.+))");
-                QRegularExpressionMatch match = re.match(logic->ErrorList.c_str());
-                textEditor->textCursor().setPosition(match.capturedTexts()[0].toInt());
-                statusBar()->showMessage(match.capturedTexts()[1]);
+                move_cursor(textEditor, diag.Line, diag.Column);
+                statusBar()->showMessage(diag.Message.c_str());
             }
             QMessageBox::critical(this, logic_name.c_str(), (std::string("Errors:\n\n") + logic->ErrorList).c_str());
         }
@@ -897,9 +899,10 @@ void TextEdit::save(const std::string &fname)
 }
 
 //***********************************************
-void TextEdit::setPosition(int newpos)
+// line and column from 0; the column may be -1 for the start of the line
+void TextEdit::setPosition(int line, int column)
 {
-    textEditor->textCursor().setPosition(newpos);
+    move_cursor(textEditor, line, column);
 }
 
 //***********************************************
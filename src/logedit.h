@@ -119,7 +119,7 @@ public:
     std::string filename;
     int open(const std::string &filename);
     void save(const std::string &filename);
-    void setPosition(int newpos);
+    void setPosition(int line, int column);
 public slots:
     void new_text();
     void clear_all();
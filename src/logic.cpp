@@ -34,3 +34,22 @@ Logic::~Logic()
     if (objlist)
         delete objlist;
 }
+
+//***************************************************
+// Reads the words and objects of the current game.
+int Logic::ReadLists()
+{
+    if (wordlist->read(game->dir + "/words.tok"))
+        return 1;
+
+    if (objlist->read(game->dir + "/object", false))
+        return 1;
+
+    // words already in lower case in file so we don't need to convert them
+    for (auto iter = objlist->ItemNames.begin(); iter < objlist->ItemNames.end(); iter++) {
+        *iter = iter->toLower();
+        iter->replace("\"", "\\\"");  //replace " with \"
+    }
+
+    return 0;
+}
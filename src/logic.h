@@ -22,7 +22,15 @@
 #define LOGIC_H
 
 
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <QStringList>
 
 #include "words.h"
 #include "object.h"
@@ -31,12 +39,85 @@
 
 
 #define MaxBlockDepth  12
-#define MaxLabels  255
-#define MaxDefines  255
 #define MaxMessages 256
-#define MaxGotos 255
 
-//Logic class used both for decode and compile
+typedef struct {
+    std::string Name;
+    int Loc;
+} TLogicLabel;
+
+#define DiagError   0
+#define DiagWarning 1
+
+//Codes of the compiler diagnostics: the pass that found the problem
+#define DiagInclude 1
+#define DiagDefine  2
+#define DiagMessage 3
+#define DiagLabel   4
+#define DiagCommand 5
+
+//A problem found by the compiler
+typedef struct {
+    std::string File;    //include file, or "" for the logic itself
+    int Line;            //from 0, as the editor counts them
+    int Column;          //from 0, or -1 if not known
+    int Severity;        //DiagError or DiagWarning
+    int Code;            //DiagInclude ... DiagCommand
+    std::string Message;
+} TDiagnostic;
+
+//Kinds of tokens of logic source
+#define TokWord      0   //name, number or command: letters, digits, '.' and '_'
+#define TokString    1   //"..."
+#define TokBadString 2   //a string without its closing quote mark
+#define TokSymbol    3   //punctuation or operator, like ( ; == +=
+#define TokDirective 4   //'#' and a name at the start of a line, like #define
+
+//A token of logic source, as read by the tokenizer
+typedef struct {
+    int Type;            //TokWord ... TokDirective
+    int Line;            //line in its file (in Logic::Tokens: index in RealLineNum)
+    int Column, EndColumn;  //where it starts and ends, in UTF-8 characters from 0
+    std::string Text;    //words and directives in lower case, strings without the quote marks
+} TLogicToken;
+
+//A #define line parsed on its own
+typedef struct {
+    int Line;            //line in its file
+    std::string Name, Value;
+    std::string Error;   //set instead of Name and Value if the line is not valid
+} TDefineLine;
+
+//A #message line parsed on its own
+typedef struct {
+    int Line;            //line in its file
+    int Num;
+    std::string Text;
+    std::string Error;   //set instead of Num and Text if the line is not valid
+} TMessageLine;
+
+//An #include file, read and parsed once for all the logics that include it
+typedef struct {
+    int NumLines;
+    std::vector<TLogicToken> Tokens;    //without the #define and #message lines
+    std::vector<TDefineLine> Defines;
+    std::vector<TMessageLine> Messages;
+} TIncludeFile;
+
+//#include files read during one build, by path and modification time.
+//The files are shared read-only by all the Logic objects using the cache.
+class IncludeCache
+{
+public:
+    std::shared_ptr<const TIncludeFile> get(const std::string &path);
+private:
+    std::mutex mutex;
+    std::map<std::string, std::pair<std::filesystem::file_time_type, std::shared_ptr<const TIncludeFile>>> files;
+};
+
+//Logic class used both for decode and compile.
+//All the compiler and decoder state is kept here, so different Logic
+//objects can compile at the same time (in different threads).
 class Logic
 {
 public:
@@ -44,13 +125,68 @@ public:
     ~Logic();
     WordList *wordlist;
     ObjList *objlist;
+    QStringList InputLines;     //source text to compile
     std::string OutputText;     //result of the decoding
-    std::string ErrorList;      //compilation error messages
-    int compile();
+    std::string ErrorList;      //compilation error messages, as text
+    std::vector<TDiagnostic> Diagnostics;  //compilation errors, in the order found
+    AGIResource Resource;       //compiled logic, or logic read by decode()
+    QStringList IncludedFiles;  //files read by #include in the last compile
+    IncludeCache *includecache = nullptr;  //where to get include files, or nullptr to read them
+    int ReadLists();
+    int compile(bool lists_read = false);
     int decode(int resnum);
 
 private:
+    //compiler state
+    int ResPos = 0, LogicSize = 0;
+    std::vector<TLogicToken> Tokens;  //the logic with its include files, directives left out
+    size_t CurToken = 0;              //next token to read
+    std::vector<std::string> IncludeFilenames;
+    std::vector<std::string> DefineNames, DefineValues;
+    std::unordered_map<std::string, int> DefineNum;  //index of each name in DefineNames
+    std::vector<int> RealLineNum, LineFile;  //line in its file, and the file (0 for the logic), of each line of Tokens
+    std::string Messages[MaxMessages];
+    bool MessageExists[MaxMessages];
+    std::vector<TLogicLabel> Labels;  //from 1; Labels[0] is not used
+    std::unordered_map<std::string, int> LabelNums;  //index of each name in Labels
+    int NumLabels = 0;
+    bool ErrorOccured = false;
+    int DiagCode = 0;          //Code of the diagnostics of the current pass
+    int CurLine = 0, CurColumn = 0;  //where the last token read ends
+    std::string ArgText;
+    std::string::size_type ArgTextLength = 0, ArgTextPos = 0;
+    bool FinishedReading = false;
+    std::string CommandName;
+    int CommandNum = 0;
+    bool NOTOn = false;
+    int EncryptionStart = 0;
+
+    //decoder state (ResPos, Messages, MessageExists, NumLabels, ErrorOccured,
+    //NOTOn and EncryptionStart are shared with the compiler)
+    int MessageSectionStart = 0, MessageSectionEnd = 0;
+    bool MessageUsed[256];
+    byte CurByte = 0;
+    int NumMessages = 0;
+    byte ThisCommand = 0;
+    byte BlockDepth = 0;
+    short BlockEnd[MaxBlockDepth + 1];
+    short BlockLength[MaxBlockDepth + 1];
+    bool BlockIsIf[MaxBlockDepth + 1];
+    short TempBlockLength = 0, CurBlock = 0;
+    byte CurArg = 0;
+    unsigned int ArgsStart = 0;
+    std::vector<byte> LabelIndex;
+    int LabelLoc = 0;
+    bool DoGoto = false;
+    std::string ThisLine;
+    bool FirstCommand = false, OROn = false;
+    byte NumSaidArgs = 0;
+    byte IndentPos = 0;
+
     void ShowError(int Line, std::string ErrorMsg);
+    byte ReadByte(void);
+    short ReadLSMSWord(void);
+    byte ReadEncByte(void);
     void DisplayMessages();
     void ReadMessages();
     int FindLabels_ReadIfs();
@@ -61,22 +197,22 @@ private:
     void AddSpecialIFSyntaxCommand();
     void ReadIfs();
 
-    std::string ReadString(std::string::size_type *pos, std::string &str);
-    int RemoveComments(QStringList &Lines);
-    int AddIncludes();
-    int ReadDefines();
-    int ReadPredefinedMessages();
+    std::string ReadString(std::string::size_type *pos, const std::string &str);
+    int AddInclude(size_t First);
+    int AddDefine(const TDefineLine &Define);
+    int AddPredefinedMessage(const TMessageLine &Message);
+    int ReadDirectives();
     int ReadLabels();
-    void NextLine();
-    void SkipSpaces();
+    void ReadToken();
+    bool NextTokenIs(const char *Text) const;
+    bool ReadTokenIf(const char *Text);
     byte MessageNum(std::string TheMessage);
     byte AddMessage(std::string TheMessage);
-    std::string ReplaceDefine(std::string InText);
+    std::string ReplaceDefine(const std::string &InText);
     void ReadArgText();
     int ReadArgValue();
     int Val(std::string str);
     void ReadArgs(bool CommandIsIf, byte CmdNum);
-    std::string ReadText();
     std::string ReadPlainText();
     std::string ReadExprText();
     void ReadCommandName();
@@ -84,7 +220,11 @@ private:
     bool AddSpecialIFSyntax();
     bool AddSpecialSyntax();
     int LabelNum(std::string LabelName);
-    bool LabelAtStartOfLine(std::string LabelName);
+    bool LabelAt(size_t Token) const;
+    void WriteByte(byte b);
+    void WriteByteAtLoc(byte b, int Loc);
+    void WriteLSMSWord(short word);
+    void WriteEncByte(byte TheByte);
     void WriteMessageSection();
     int CompileCommands();
 };
@@ -19,8 +19,13 @@
  */
 
 
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
 #include <QApplication>
 #include <QMainWindow>
+#include <QSettings>
 
 #include "menu.h"
 #include "game.h"
@@ -39,19 +44,104 @@ where [switches] are optionally:\n\
 \n\
 -dir GAMEDIR   : open an existing game in GAMEDIR\n\
 -help          : this message\n\
+\n\
+Batch mode (no windows are opened, errors are written to stderr and the\n\
+exit status is 0 on success and 1 on errors):\n\
+\n\
+--build GAMEDIR            : recompile all logics of the game\n\
+--rebuild-vol GAMEDIR      : rebuild the VOL files of the game\n\
+--extract-all GAMEDIR      : extract all resources of the game\n\
+--decompile GAMEDIR        : write the source code of all logics of the game\n\
+--render-pictures GAMEDIR  : write the visual and priority screens of all\n\
+                             pictures of the game as PNG images\n\
+--raw                      : with --render-pictures, also write the screens\n\
+                             as raw files (one byte per pixel, 160x168)\n\
+--output DIR               : where --extract-all, --decompile and\n\
+                             --render-pictures write files. Needed by\n\
+                             --extract-all and --decompile, and must not be\n\
+                             the game's source directory; --render-pictures\n\
+                             writes to the source directory by default\n\
 \n";
 
+static const char *batch_commands[] = {"build", "rebuild-vol", "extract-all", "decompile", "render-pictures"};
+
+//***************************************************
+// Run a batch mode command on the game in 'gamedir'.
+// Returns the exit status of the program.
+static int run_batch(const std::string &command, const char *gamedir, const char *outdir, bool raw)
+{
+    int err = 0, count = 0;
+
+    // extracted and decompiled logics are named like their source files,
+    // so they must not be written over them
+    if ((command == "extract-all" || command == "decompile") && !outdir) {
+        menu->errmes("--%s needs --output DIR.", command.c_str());
+        return 1;
+    }
+
+    if (game->open(gamedir))
+        return 1;
+
+    if (command == "build")
+        err = game->RecompileAll();
+    else if (command == "rebuild-vol")
+        err = game->RebuildVOLfiles();
+    else if (command == "render-pictures")
+        err = game->RenderPictures(outdir ? outdir : game->srcdir, raw);
+    else {
+        bool decompile = (command == "decompile");
+        bool logic_as_text = decompile || game->settings->value("ExtractLogicAsText").toBool();
+        QString dir = outdir;
+        std::error_code ec;
+        if (std::filesystem::equivalent(dir.toStdString(), game->srcdir, ec)) {
+            menu->errmes("--%s can't write to the source directory '%s'.", command.c_str(), game->srcdir.c_str());
+            return 1;
+        }
+        for (int restype = 0; restype <= 3; restype++) {
+            if (decompile && restype != LOGIC)
+                continue;
+            for (int resnum = 0; resnum < 256; resnum++) {
+                if (!game->ResourceInfo[restype][resnum].Exists)
+                    continue;
+                auto filename = QString("%1/%2.%3").arg(dir).arg(ResTypeName[restype]).arg(QString::number(resnum), 3, '0');
+                if (game->ExtractResource(filename.toStdString(), restype, resnum, logic_as_text))
+                    err = 1;
+                else
+                    count++;
+            }
+        }
+        menu->infomes("%d resources written to %s", count, dir.toStdString().c_str());
+    }
+
+    return (err || menu->num_errors > 0) ? 1 : 0;
+}
+
 //***************************************************
 int main(int argc, char **argv)
 {
     char *gamedir = NULL;
+    char *outdir = NULL;
+    bool raw = false;     //--raw
+    std::string command;  //batch mode command
 
     tmp[0] = 0;
 
     for (int i = 1; i < argc; i++) {
         if (argv[i][0] == '-') {
+            bool is_batch_command = false;
+            for (const char *cmd : batch_commands) {
+                if (argv[i][1] == '-' && !strcmp(argv[i] + 2, cmd))
+                    is_batch_command = true;
+            }
             if (!strcmp(argv[i] + 1, "dir"))
                 gamedir = argv[i + 1];
+            else if (is_batch_command && i + 1 < argc && command.empty()) {
+                command = argv[i] + 2;
+                gamedir = argv[++i];
+            } else if (!strcmp(argv[i] + 1, "-output") && i + 1 < argc)
+                outdir = argv[++i];
+            else if (!strcmp(argv[i] + 1, "-raw"))
+                raw = true;
             else {
                 if (strcmp(argv[i] + 1, "help") != 0 && strcmp(argv[i] + 1, "-help") != 0)
                     printf("Unknown parameter.\n\n");
@@ -61,6 +151,17 @@ int main(int argc, char **argv)
         }
     }
 
+    if (!command.empty()) {
+        // no display is needed in batch mode
+        if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+            qputenv("QT_QPA_PLATFORM", "offscreen");
+        app = new QApplication(argc, argv);
+        menu = new Menu(NULL, NULL);
+        menu->batch = true;
+        game = new Game();
+        return run_batch(command, gamedir, outdir, raw);
+    }
+
     app = new QApplication(argc, argv);
     menu = new Menu(NULL, NULL);
 
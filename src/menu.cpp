@@ -20,6 +20,7 @@
 
 
 #include <cstdarg>
+#include <cstdio>
 #include <vector>
 
 #include <QActionGroup>
@@ -52,7 +53,7 @@ WinList winlist[MAXWIN];  //list of all open resource editor windows
 
 //*************************************************
 Menu::Menu(QWidget *parent, const char *name)
-    : QMainWindow(parent), resources_win(nullptr), num_res(0)
+    : QMainWindow(parent), resources_win(nullptr), batch(false), num_errors(0), num_res(0)
 {
     setupUi(this);
 
@@ -629,10 +630,18 @@ void Menu::errmes(const char *fmt, ...)
 
     va_start(argp, fmt);
     std::vector<char> buffer(std::vsnprintf(nullptr, 0, fmt, argp) + 1);
+    va_end(argp);
+    va_start(argp, fmt);
     vsnprintf(buffer.data(), buffer.size(), fmt, argp);
-    err->setText(buffer.data());
     va_end(argp);
 
+    if (batch) {
+        fprintf(stderr, "error: %s\n", buffer.data());
+        num_errors++;
+        return;
+    }
+
+    err->setText(buffer.data());
     err->setWindowTitle("AGI studio");
     err->show();
 }
@@ -644,14 +653,41 @@ void Menu::warnmes(const char *fmt, ...)
 
     va_start(argp, fmt);
     std::vector<char> buffer(std::vsnprintf(nullptr, 0, fmt, argp) + 1);
+    va_end(argp);
+    va_start(argp, fmt);
     vsnprintf(buffer.data(), buffer.size(), fmt, argp);
-    warn->setText(buffer.data());
     va_end(argp);
 
+    if (batch) {
+        fprintf(stderr, "warning: %s\n", buffer.data());
+        return;
+    }
+
+    warn->setText(buffer.data());
     warn->setWindowTitle("AGI studio");
     warn->show();
 }
 
+//**********************************************
+void Menu::infomes(const char *fmt, ...)
+{
+    std::va_list argp;
+
+    va_start(argp, fmt);
+    std::vector<char> buffer(std::vsnprintf(nullptr, 0, fmt, argp) + 1);
+    va_end(argp);
+    va_start(argp, fmt);
+    vsnprintf(buffer.data(), buffer.size(), fmt, argp);
+    va_end(argp);
+
+    if (batch) {
+        printf("%s\n", buffer.data());
+        return;
+    }
+
+    QMessageBox::information(this, "AGI studio", buffer.data());
+}
+
 //**********************************************
 
 About::About(QWidget *parent, const char *name)
@@ -65,6 +65,12 @@ public:
     void showStatusMessage(const QString &msg);
     void errmes(const char *, ...);
     void warnmes(const char *, ...);
+    void infomes(const char *, ...);
+
+    // Command line batch mode: messages go to stdout/stderr instead of
+    // message boxes, and errors are counted for the exit code.
+    bool batch;
+    int num_errors;
 
     void enable_game_actions(void);
     void disable_game_actions(void);
@@ -37,33 +37,43 @@ ObjList::ObjList() :
 { }
 
 //****************************************************
-bool ObjList::GetItems()
+// Byte 'pos' of the object file, or 0 if it is past the end of the file.
+static byte DataByte(const std::vector<byte> &Data, int pos)
+{
+    if (pos >= 0 && pos < (int)Data.size())
+        return Data[pos];
+    return 0;
+}
+
+//****************************************************
+bool ObjList::GetItems(const std::vector<byte> &Data)
 {
     std::string ThisItemName;
     int NamePos;
     int CurrentItem, ItemNamesStart, ThisNameStart;
     byte lsbyte, msbyte;
+    int Size = Data.size();
 
     CurrentItem = 0;
-    lsbyte = ResourceData.Data[0];
-    msbyte = ResourceData.Data[1];
+    lsbyte = DataByte(Data, 0);
+    msbyte = DataByte(Data, 1);
     ItemNamesStart = msbyte * 256 + lsbyte + 3;
-    MaxScreenObjects = ResourceData.Data[2];
+    MaxScreenObjects = DataByte(Data, 2);
     do {
-        lsbyte = ResourceData.Data[3 + CurrentItem * 3];
-        msbyte = ResourceData.Data[3 + CurrentItem * 3 + 1];
+        lsbyte = DataByte(Data, 3 + CurrentItem * 3);
+        msbyte = DataByte(Data, 3 + CurrentItem * 3 + 1);
         ThisNameStart = (msbyte << 8) | lsbyte + 3;
-        RoomNum[CurrentItem] = ResourceData.Data[3 + CurrentItem * 3 + 2];
+        RoomNum[CurrentItem] = DataByte(Data, 3 + CurrentItem * 3 + 2);
         NamePos = ThisNameStart;
-        if (NamePos > ResourceData.Size)
+        if (NamePos > Size)
             return false; //object name past end of file
         ThisItemName = "";
         do {
-            if (ResourceData.Data[NamePos] > 0) {
-                ThisItemName += ResourceData.Data[NamePos];
+            if (DataByte(Data, NamePos) > 0) {
+                ThisItemName += DataByte(Data, NamePos);
                 NamePos++;
             }
-        } while (ResourceData.Data[NamePos] != 0 && NamePos < ResourceData.Size);
+        } while (DataByte(Data, NamePos) != 0 && NamePos < Size);
         ItemNames.append(ThisItemName.c_str());
         CurrentItem++;
 
@@ -72,10 +82,10 @@ bool ObjList::GetItems()
 }
 
 //****************************************************
-void ObjList::XORData()
+void ObjList::XORData(std::vector<byte> &Data)
 {
-    for (int i = 0; i < ResourceData.Size; i++)
-        ResourceData.Data[i] ^= EncryptionKey[i % 11];
+    for (size_t i = 0; i < Data.size(); i++)
+        Data[i] ^= EncryptionKey[i % 11];
 }
 
 //****************************************************
@@ -94,15 +104,15 @@ int ObjList::read(const std::string &filename, bool FileIsEncrypted)
     }
 
     ItemNames.clear();
-    ResourceData.Size = size;
-    object_stream.read(reinterpret_cast<char *>(ResourceData.Data), ResourceData.Size);
+    std::vector<byte> Data(size);
+    object_stream.read(reinterpret_cast<char *>(Data.data()), size);
     object_stream.close();
     if (FileIsEncrypted)
-        XORData();
-    if (!GetItems()) {
-        XORData();
+        XORData(Data);
+    if (!GetItems(Data)) {
+        XORData(Data);
         FileIsEncrypted = !FileIsEncrypted;
-        if (!GetItems()) {
+        if (!GetItems(Data)) {
             menu->errmes("Error! Invalid OBJECT file.");
             return 1;
         }
@@ -121,43 +131,45 @@ int ObjList::save(const std::string &filename, bool FileIsEncrypted)
     byte lsbyte, msbyte;
     int ItemNamesStart, ObjectFilePos;
     size_t CurrentItem, CurrentChar;
+    int Size;
 
-    ResourceData.Size = ItemNames.count() * 3 + 5;
+    Size = ItemNames.count() * 3 + 5;
     //3 bytes for each index entry, 3 bytes for header, 2 for '?' object
     for (CurrentItem = 1; CurrentItem <= ItemNames.count(); CurrentItem++) {
         if (ItemNames.at(CurrentItem - 1) != "?")
-            ResourceData.Size += ItemNames.at(CurrentItem - 1).length() + 1;
+            Size += ItemNames.at(CurrentItem - 1).length() + 1;
     }
 
-    //create data
+    //create data (one spare byte: Data[5] is set even if there are no objects)
+    std::vector<byte> Data(Size + 1);
     ItemNamesStart = ItemNames.count() * 3 + 3;
     msbyte = (ItemNamesStart - 3) / 256;
     lsbyte = (ItemNamesStart - 3) % 256;
-    ResourceData.Data[0] = lsbyte;
-    ResourceData.Data[1] = msbyte;
-    ResourceData.Data[2] = MaxScreenObjects;
-    ResourceData.Data[3] = lsbyte;
-    ResourceData.Data[4] = msbyte;
-    ResourceData.Data[5] = 0;
-    ResourceData.Data[ItemNamesStart] = '?';
-    ResourceData.Data[ItemNamesStart + 1] = 0;
+    Data[0] = lsbyte;
+    Data[1] = msbyte;
+    Data[2] = MaxScreenObjects;
+    Data[3] = lsbyte;
+    Data[4] = msbyte;
+    Data[5] = 0;
+    Data[ItemNamesStart] = '?';
+    Data[ItemNamesStart + 1] = 0;
     ObjectFilePos = ItemNamesStart + 2;
     for (CurrentItem = 1; CurrentItem <= ItemNames.count(); CurrentItem++) {
         if (ItemNames.at(CurrentItem - 1) == "?") {
-            ResourceData.Data[CurrentItem * 3] = ResourceData.Data[0];
-            ResourceData.Data[CurrentItem * 3 + 1] = ResourceData.Data[1];
-            ResourceData.Data[CurrentItem * 3 + 2] = RoomNum[CurrentItem - 1];
+            Data[CurrentItem * 3] = Data[0];
+            Data[CurrentItem * 3 + 1] = Data[1];
+            Data[CurrentItem * 3 + 2] = RoomNum[CurrentItem - 1];
         } else {
             msbyte = (ObjectFilePos - 3) / 256;
             lsbyte = (ObjectFilePos - 3) % 256;
-            ResourceData.Data[CurrentItem * 3] = lsbyte;;
-            ResourceData.Data[CurrentItem * 3 + 1] = msbyte;
-            ResourceData.Data[CurrentItem * 3 + 2] = RoomNum[CurrentItem - 1];
+            Data[CurrentItem * 3] = lsbyte;;
+            Data[CurrentItem * 3 + 1] = msbyte;
+            Data[CurrentItem * 3 + 2] = RoomNum[CurrentItem - 1];
             for (CurrentChar = 0; CurrentChar < ItemNames.at(CurrentItem - 1).length(); CurrentChar++) {
-                ResourceData.Data[ObjectFilePos] = ItemNames.at(CurrentItem - 1)[CurrentChar].toLatin1();
+                Data[ObjectFilePos] = ItemNames.at(CurrentItem - 1)[CurrentChar].toLatin1();
                 ObjectFilePos++;
             }
-            ResourceData.Data[ObjectFilePos] = 0;
+            Data[ObjectFilePos] = 0;
             ObjectFilePos++;
         }
     }//end create data
@@ -166,10 +178,11 @@ int ObjList::save(const std::string &filename, bool FileIsEncrypted)
         menu->errmes("Error opening file '%s'!", filename.c_str());
         return 1;
     }
+    Data.resize(Size);
     if (FileIsEncrypted)
-        XORData();
+        XORData(Data);
 
-    object_stream.write(reinterpret_cast<char *>(ResourceData.Data), ResourceData.Size);
+    object_stream.write(reinterpret_cast<char *>(Data.data()), Size);
     object_stream.close();
     return 0;
 }
@@ -22,6 +22,9 @@
 #define OBJECT_H
 
 
+#include <string>
+#include <vector>
+
 #include <QStringList>
 
 
@@ -37,10 +40,10 @@ public:
     QStringList ItemNames;
     byte RoomNum[MaxItems];
     byte MaxScreenObjects; //what this is for ?
-    void XORData();
+    void XORData(std::vector<byte> &Data);
     int read(const std::string &filename, bool FileIsEncrypted);
     int save(const std::string &filename, bool FileIsEncrypted);
-    bool GetItems();
+    bool GetItems(const std::vector<byte> &Data);
     void clear();
 };
 
@@ -25,6 +25,7 @@
 #include <QListWidget>
 #include <QMessageBox>
 #include <QMouseEvent>
+#include <QPaintEvent>
 #include <QPainter>
 #include <QSettings>
 #include <QTextEdit>
@@ -680,6 +681,21 @@ void PicEdit::editor_help()
 }
 
 
+//************************************************
+PCanvasImage::PCanvasImage(QWidget *parent, int w, int h)
+    : QWidget(parent), pixmap(w, h)
+{
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    resize(w, h);
+}
+
+//*********************************************
+void PCanvasImage::paintEvent(QPaintEvent *e)
+{
+    QPainter p(this);
+    p.drawPixmap(e->rect(), pixmap, e->rect());
+}
+
 //************************************************
 //
 PCanvas::PCanvas(QWidget *parent, const char *name, PicEdit *w)
@@ -687,14 +703,12 @@ PCanvas::PCanvas(QWidget *parent, const char *name, PicEdit *w)
       picedit(w), pixsize(2), x0(0), y0(0), x1(0), y1(0),
       bg_loaded(false), bg_on(false), imagecontainer(),
       cur_w(MAX_W * pixsize), cur_h(MAX_HH * pixsize), pri_lines(false),
-      bgpix(), pixmap(cur_w, cur_h), CurColor(), linedraw()
+      bgpix(), CurColor(), linedraw()
       // The area to draw picture
 {
     picture = picedit->picture;
 
-    imagecontainer = new QLabel(this);
-    imagecontainer->resize(cur_w, cur_h);
-    imagecontainer->setPixmap(pixmap);
+    imagecontainer = new PCanvasImage(this, cur_w, cur_h);
     imagecontainer->setMouseTracking(true);
 
     this->setFrameStyle(QFrame::NoFrame);
@@ -706,6 +720,7 @@ PCanvas::PCanvas(QWidget *parent, const char *name, PicEdit *w)
 void PCanvas::setSize(int w, int h)
 {
     if (cur_w != w || cur_h != h) {
+        QPixmap &pixmap = imagecontainer->pixmap;
         pixmap = pixmap.scaled(w * pixsize * 2, h * pixsize);
         cur_w = w;
         cur_h = h;
@@ -718,12 +733,13 @@ void PCanvas::setPixsize(int s)
     pixsize = s;
     cur_w = MAX_W * pixsize;
     cur_h = MAX_HH * pixsize;
+    QPixmap &pixmap = imagecontainer->pixmap;
     pixmap = pixmap.scaled(cur_w, cur_h);
     QPainter p(&pixmap);
     p.eraseRect(0, 0, cur_w, cur_h);
     p.end();
-    update();
     imagecontainer->resize(cur_w, cur_h);
+    update();
 }
 
 //*********************************************
@@ -755,7 +771,7 @@ void PCanvas::mousePressEvent(QMouseEvent *event)
         picture->tool = -1;
         picture->init_tool();
     }
-    update();
+    updateChanged();
     picedit->changed = true;
 }
 
@@ -803,39 +819,67 @@ void PCanvas::drawContents(QPainter *p, int, int, int, int) const
     if (cur_w == 0 || cur_h == 0)
         return;
 
-    p->drawPixmap(x0, y0, pixmap);
+    p->drawPixmap(x0, y0, imagecontainer->pixmap);
+}
+
+//*********************************************
+// The canvas area (MAX_W x MAX_HH) covered by 'points'. Their x is a picture
+// x coordinate, or a canvas one if 'doubled'.
+static QRect points_rect(const Points *points, bool doubled)
+{
+    QRect r;
+
+    for (int i = 0; i < points->n; i++) {
+        if (doubled)
+            r |= QRect(points->p[i].x, points->p[i].y, 1, 1);
+        else
+            r |= QRect(points->p[i].x * 2, points->p[i].y, 2, 1);
+    }
+    return r;
 }
 
 //*********************************************
 void PCanvas::update()
 {
-    QPainter p(&pixmap);
-    int x, y;
-    byte c;
+    redraw(QRect(0, 0, MAX_W, MAX_HH));
+}
+
+//*********************************************
+// Like update(), but only redraw the pixels the picture has changed since
+// the last redraw and the line following the cursor.
+void PCanvas::updateChanged()
+{
+    const TPicRect &changed = picture->changed;
+    QRect area;
+
+    if (changed.x1 <= changed.x2)
+        area = QRect(changed.x1 * 2, changed.y1, (changed.x2 - changed.x1 + 1) * 2, changed.y2 - changed.y1 + 1);
+    if (linedraw)
+        area |= points_rect(picture->newp, false);
+    area &= QRect(0, 0, MAX_W, MAX_HH);
+    if (!area.isEmpty())
+        redraw(area);
+}
+
+//*********************************************
+// Draw 'area' of the canvas (in MAX_W x MAX_HH coordinates) from the picture
+void PCanvas::redraw(const QRect &area)
+{
+    QPainter p(&imagecontainer->pixmap);
+    int y;
     byte *data;
+    QRect target(area.x() * pixsize, area.y() * pixsize, area.width() * pixsize, area.height() * pixsize);
 
     data = (picedit->pri_mode) ? picture->priority : picture->picture;
-    if (bg_loaded && bg_on) { //if must draw background
-        bool pic = !picedit->pri_mode;
-        for (y = 0; y < MAX_HH; y++) {
-            for (x = 0; x < MAX_W; x += 2) {
-                c = data[y * MAX_W + x];
-                if ((pic && c == 15) || (!pic && c == 4)) { //draw background instead of "empty" areas
-                    p.fillRect(x * pixsize, y * pixsize, pixsize, pixsize, QColor(bgpix.pixel(x, y)));
-                    p.fillRect((x + 1)*pixsize, y * pixsize, pixsize, pixsize, QColor(bgpix.pixel(x + 1, y)));
-                } else
-                    p.fillRect(x * pixsize, y * pixsize, pixsize * 2, pixsize, egacolor[c]);
-            }
-        }
-    } else {
-        for (y = 0; y < MAX_HH; y++) {
-            for (x = 0; x < MAX_W; x += 2)
-                p.fillRect(x * pixsize, y * pixsize, pixsize * 2, pixsize, egacolor[data[y * MAX_W + x]]);
-        }
-    }
+    //draw background instead of "empty" areas if it is on
+    const QImage *bg = (bg_loaded && bg_on) ? &bgpix : nullptr;
+    QImage image = picture_image(data, PIC_W, bg, picedit->pri_mode ? 4 : 15);
+    p.drawImage(target, image, area);
     linedraw = false;
+    picture->resetChanged();
 
     if (pri_lines) {
+        p.setClipRect(target);
         QPen pen;
         pen.setStyle(Qt::DashLine);
         pen.setWidth(1);
@@ -854,8 +898,7 @@ void PCanvas::update()
             p.drawLine(0, y + 1, MAX_W * pixsize, y + 1);
         }
     }
-    repaint(x0, y0, x0 + MAX_W * pixsize, y0 + MAX_HH * pixsize);
-    imagecontainer->setPixmap(pixmap);
+    imagecontainer->update(target);
 }
 
 //*********************************************
@@ -864,7 +907,7 @@ void PCanvas::line(bool mode)
 //mode==true - erase the old one, draw the new one
 //mode==false - only erase the old one
 {
-    QPainter p(&pixmap);
+    QPainter p(&imagecontainer->pixmap);
     byte c;
     Points *curp, *newp = NULL;
     int i;
@@ -903,51 +946,12 @@ void PCanvas::line(bool mode)
     } else
         linedraw = false;
 
-#if 0
-    //find the max rectangle to repaint
-    if (curp->n) {
-        if (picture->bg_on) {
-            x00 = curp->p[0].x;
-            y00 = curp->p[0].y;
-            x11 = curp->p[curp->n - 1].x;
-            y11 = curp->p[curp->n - 1].y;
-        } else {
-            x00 = curp->p[0].x * 2;
-            y00 = curp->p[0].y;
-            x11 = curp->p[curp->n - 1].x * 2;
-            y11 = curp->p[curp->n - 1].y;
-        }
-        if (newp) {
-            x0_ = newp->p[0].x * 2;
-            y0_ = newp->p[0].y;
-            x1 = newp->p[newp->n - 1].x * 2;
-            y1 = newp->p[newp->n - 1].y;
-
-            X0 = (MIN(MIN(x00, x0_), MIN(x11, x1))) * pixsize;
-            Y0 = (MIN(MIN(y00, y0_), MIN(y11, y1))) * pixsize;
-            X1 = (MAX(MAX(x00, x0_), MAX(x11, x1))) * pixsize;
-            Y1 = (MAX(MAX(y00, y0_), MAX(y11, y1))) * pixsize;
-        } else {
-            X0 = (MIN(x00, x11)) * pixsize;
-            Y0 = (MIN(y00, y11)) * pixsize;
-            X1 = (MAX(x00, x11)) * pixsize;
-            Y1 = (MAX(y00, y11)) * pixsize;
-        }
-    } else {
-
-        x0_ = newp->p[0].x * 2 * pixsize;
-        y0_ = newp->p[0].y * pixsize;
-        x1 = newp->p[newp->n - 1].x * 2 * pixsize;
-        y1 = newp->p[newp->n - 1].y * pixsize;
-        X0 = MIN(x0_, x1);
-        Y0 = MIN(y0_, y1);
-        X1 = MAX(x0_, x1);
-        Y1 = MAX(y0_, y1);
-
-    }
-#endif
-    repaint(x0, y0, x0 + MAX_W * pixsize, y0 + MAX_HH * pixsize);
-    imagecontainer->setPixmap(pixmap);
+    //repaint only the pixels of the old and the new line
+    QRect area = points_rect(curp, picture->bg_on);
+    if (newp)
+        area |= points_rect(newp, false);
+    if (!area.isEmpty())
+        imagecontainer->update(area.x() * pixsize, area.y() * pixsize, area.width() * pixsize, area.height() * pixsize);
 }
 
 //*********************************************
@@ -1020,6 +1024,9 @@ void PCanvas::load_bg(QString &filename)
         menu->errmes("Can't open file '%s'!", filename.toStdString().c_str());
         return;
     }
+    // the part under the picture, in the format picture_image() blends with
+    // (copy() fills whatever is outside a smaller image with black)
+    bgpix = bgpix.convertToFormat(QImage::Format_RGB32).copy(0, 0, MAX_W, MAX_HH);
     bg_loaded = true;
 
     picture->bgpix = &bgpix;
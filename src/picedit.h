@@ -59,6 +59,19 @@ protected:
     void mousePressEvent(QMouseEvent *event);
 };
 
+//************************************************
+// The picture shown in PCanvas. It owns the pixmap the canvas draws into,
+// so a change repaints only the area that was drawn.
+class PCanvasImage : public QWidget
+{
+    Q_OBJECT
+public:
+    PCanvasImage(QWidget *parent, int w, int h);
+    QPixmap pixmap;
+protected:
+    void paintEvent(QPaintEvent *e);
+};
+
 //************************************************
 class PCanvas : public QScrollArea
 {
@@ -75,15 +88,16 @@ public:
     void load_bg(QString &filename);
     void draw(int ResNum);
     void update();
+    void updateChanged();
     void setSize(int w, int h);
     void setPixsize(int pixsize);
 protected:
     int CurColor;
     Picture *picture;
-    QLabel *imagecontainer;
-    QPixmap pixmap;
+    PCanvasImage *imagecontainer;
     QImage bgpix;
     PicEdit *picedit;
+    void redraw(const QRect &area);
     void closeEvent(QCloseEvent *e);
     void showEvent(QShowEvent *);
     void hideEvent(QHideEvent *);
@@ -0,0 +1,563 @@
+/*
+ *  QT AGI Studio :: Copyright (C) 2000 Helen Zommer
+ *
+ *  Almost all of the picture processing code is taken from showpic.c
+ *  by Lance Ewing <lance.e@ihug.co.nz>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "picture.h"
+
+
+//********************************************
+template <class Codes, bool EditState>
+PictureRasterizer<Codes, EditState>::PictureRasterizer() :
+    picDrawEnabled(), priDrawEnabled(), picColour(), priColour(), patCode(), patNum(),
+    tool(-1), changed{PIC_W, MAX_H, -1, -1}, picScreen(), priScreen()
+{ }
+
+//********************************************
+// Clear the screens and reset the drawing state, to draw a new picture.
+template <class Codes, bool EditState>
+void PictureRasterizer<Codes, EditState>::clear()
+{
+    memset(picScreen, 15, PIC_W * MAX_H); /* Visual screen default, white */
+    memset(priScreen, 4, PIC_W * MAX_H);  /* Priority screen default, red */
+    picDrawEnabled = false;
+    priDrawEnabled = false;
+    picColour = priColour = 0;
+    patCode = patNum = 0;
+    if constexpr (EditState)
+        changed = {0, 0, PIC_W - 1, MAX_H - 1};
+}
+
+//********************************************
+template <class Codes, bool EditState>
+void PictureRasterizer<Codes, EditState>::resetChanged()
+{
+    changed = {PIC_W, MAX_H, -1, -1};
+}
+
+//********************************************
+// Add pixels x1..x2 of line y to the changed area.
+template <class Codes, bool EditState>
+void PictureRasterizer<Codes, EditState>::markChanged(int x1, int x2, int y)
+{
+    if constexpr (EditState) {
+        changed.x1 = std::min(changed.x1, x1);
+        changed.x2 = std::max(changed.x2, x2);
+        changed.y1 = std::min(changed.y1, y);
+        changed.y2 = std::max(changed.y2, y);
+    }
+}
+
+/**************************************************************************
+** drawAction
+**
+** Draws the action 'action', reading its data from 'codes'. Returns false
+** at the end of the picture.
+**************************************************************************/
+template <class Codes, bool EditState>
+bool PictureRasterizer<Codes, EditState>::drawAction(byte action, Codes &codes)
+{
+    switch (action) {
+        case SetPicColor:
+            picColour = codes.next();
+            picDrawEnabled = true;
+            break;
+        case EnablePriority:
+            picDrawEnabled = false;
+            break;
+        case SetPriColor:
+            priColour = codes.next();
+            priDrawEnabled = true;
+            break;
+        case EnableVisual:
+            priDrawEnabled = false;
+            break;
+        case YCorner:
+            if constexpr (EditState)
+                tool = T_STEP;
+            yCorner(codes);
+            break;
+        case XCorner:
+            if constexpr (EditState)
+                tool = T_STEP;
+            xCorner(codes);
+            break;
+        case AbsoluteLine:
+            if constexpr (EditState)
+                tool = T_LINE;
+            absoluteLine(codes);
+            break;
+        case RelativeLine:
+            if constexpr (EditState)
+                tool = T_PEN;
+            relativeDraw(codes);
+            break;
+        case Fill:
+            if constexpr (EditState)
+                tool = T_FILL;
+            fill(codes);
+            break;
+        case SetPattern:
+            patCode = codes.next();
+            break;
+        case Brush:
+            if constexpr (EditState)
+                tool = T_BRUSH;
+            plotBrush(codes);
+            break;
+        case DrawEnd:
+            return false;
+        default:
+            printf("Unknown picture code : %X\n", action);
+            break;
+    }
+    return true;
+}
+
+/**************************************************************************
+** picPSet
+**
+** Draws a pixel in the picture screen.
+**************************************************************************/
+template <class Codes, bool EditState>
+void PictureRasterizer<Codes, EditState>::picPSet(word x, word y)
+{
+    if (x >= PIC_W)
+        return;
+    if (y >= MAX_H)
+        return;
+    picScreen[y * PIC_W + x] = picColour;
+    markChanged(x, x, y);
+}
+
+/**************************************************************************
+** priPSet
+**
+** Draws a pixel in the priority screen.
+**************************************************************************/
+template <class Codes, bool EditState>
+void PictureRasterizer<Codes, EditState>::priPSet(word x, word y)
+{
+    if (x >= PIC_W)
+        return;
+    if (y >= MAX_H)
+        return;
+    priScreen[y * PIC_W + x] = priColour;
+    markChanged(x, x, y);
+}
+
+/**************************************************************************
+** pset
+**
+** Draws a pixel in each screen depending on whether drawing in that
+** screen is enabled or not.
+**************************************************************************/
+template <class Codes, bool EditState>
+void PictureRasterizer<Codes, EditState>::pset(word x, word y)
+{
+    if (picDrawEnabled)
+        picPSet(x, y);
+    if (priDrawEnabled)
+        priPSet(x, y);
+}
+
+/**************************************************************************
+** picGetPixel
+**
+** Get colour at x,y on the picture page.
+**************************************************************************/
+template <class Codes, bool EditState>
+byte PictureRasterizer<Codes, EditState>::picGetPixel(word x, word y) const
+{
+    if (x >= PIC_W)
+        return 4;
+    if (y >= MAX_H)
+        return 4;
+
+    return picScreen[y * PIC_W + x];
+}
+
+/**************************************************************************
+** priGetPixel
+**
+** Get colour at x,y on the priority page.
+**************************************************************************/
+template <class Codes, bool EditState>
+byte PictureRasterizer<Codes, EditState>::priGetPixel(word x, word y) const
+{
+    if (x >= PIC_W)
+        return 4;
+    if (y >= MAX_H)
+        return 4;
+
+    return priScreen[y * PIC_W + x];
+}
+
+/**************************************************************************
+** drawline
+**
+** Draws an AGI line.
+**************************************************************************/
+template <class Codes, bool EditState>
+void PictureRasterizer<Codes, EditState>::drawline(word x1, word y1, word x2, word y2)
+{
+    agiLine(x1, y1, x2, y2, [this](int x, int y) {
+        pset(x, y);
+    });
+}
+
+/**************************************************************************
+** okToFill
+**************************************************************************/
+template <class Codes, bool EditState>
+bool PictureRasterizer<Codes, EditState>::okToFill(byte x, byte y)
+{
+    if (!picDrawEnabled && !priDrawEnabled)
+        return false;
+    if (picColour == 15)
+        return false;
+    if (!priDrawEnabled)
+        return (picGetPixel(x, y) == 15);
+    if (priDrawEnabled && !picDrawEnabled)
+        return (priGetPixel(x, y) == 4);
+    return (picGetPixel(x, y) == 15);
+}
+
+/**************************************************************************
+** agiFill
+**
+** Fills a line at a time. The pixels filled are the same as with the
+** original AGI fill, which went a pixel at a time: it never goes down
+** from line 167, so an area below it can only be filled from a start
+** point there. (The original never finished if it reached a pixel that
+** filling doesn't change, i.e. off the screen or priority colour 4 on
+** the priority screen; such pixels are not filled here.)
+**************************************************************************/
+template <class Codes, bool EditState>
+void PictureRasterizer<Codes, EditState>::agiFill(word x, word y)
+{
+    x = (byte)x;
+    y = (byte)y;
+    if (!okToFill(x, y) || x >= PIC_W || y >= MAX_H)
+        return;
+
+    // the screen that tells which pixels are still to be filled
+    bool pri = (priDrawEnabled && !picDrawEnabled);
+    byte *screen = pri ? priScreen : picScreen;
+    byte empty = pri ? 4 : 15;
+    if (pri && priColour == 4)
+        return;
+
+    fillStack.clear();
+    fillStack.push_back({(byte)x, (byte)y});
+    while (!fillStack.empty()) {
+        TFillPoint p = fillStack.back();
+        fillStack.pop_back();
+
+        byte *line = screen + p.y * PIC_W;
+        if (line[p.x] != empty)
+            continue;
+        int x1 = p.x, x2 = p.x;
+        while (x1 > 0 && line[x1 - 1] == empty)
+            x1--;
+        while (x2 < PIC_W - 1 && line[x2 + 1] == empty)
+            x2++;
+
+        int offset = p.y * PIC_W + x1, len = x2 - x1 + 1;
+        if (picDrawEnabled)
+            memset(picScreen + offset, picColour, len);
+        if (priDrawEnabled)
+            memset(priScreen + offset, priColour, len);
+        markChanged(x1, x2, p.y);
+
+        // push the start of each empty run next to the line just filled
+        for (int y1 = p.y - 1; y1 <= p.y + 1; y1 += 2) {
+            if ((y1 < p.y && p.y == 0) || (y1 > p.y && (p.y == 167 || y1 >= MAX_H)))
+                continue;
+            line = screen + y1 * PIC_W;
+            for (int x3 = x1; x3 <= x2; x3++)
+                if (line[x3] == empty && (x3 == x1 || line[x3 - 1] != empty))
+                    fillStack.push_back({(byte)x3, (byte)y1});
+        }
+    }
+}
+
+/**************************************************************************
+** xCorner
+**
+** Draws an xCorner  (drawing action 0xF5)
+**************************************************************************/
+template <class Codes, bool EditState>
+void PictureRasterizer<Codes, EditState>::xCorner(Codes &codes)
+{
+    byte x1, x2, y1, y2;
+
+    x1 = codes.next();
+    y1 = codes.next();
+
+    pset(x1, y1);
+
+    for (;;) {
+        x2 = codes.next();
+        if (x2 >= action_codes_start)
+            break;
+        drawline(x1, y1, x2, y1);
+        x1 = x2;
+        y2 = codes.next();
+        if (y2 >= action_codes_start)
+            break;
+        drawline(x1, y1, x1, y2);
+        y1 = y2;
+    }
+
+    codes.back();
+}
+
+/**************************************************************************
+** yCorner
+**
+** Draws an yCorner  (drawing action 0xF4)
+**************************************************************************/
+template <class Codes, bool EditState>
+void PictureRasterizer<Codes, EditState>::yCorner(Codes &codes)
+{
+    byte x1, x2, y1, y2;
+
+    x1 = codes.next();
+    y1 = codes.next();
+
+    pset(x1, y1);
+
+    for (;;) {
+        y2 = codes.next();
+        if (y2 >= action_codes_start)
+            break;
+        drawline(x1, y1, x1, y2);
+        y1 = y2;
+        x2 = codes.next();
+        if (x2 >= action_codes_start)
+            break;
+        drawline(x1, y1, x2, y1);
+        x1 = x2;
+    }
+
+    codes.back();
+}
+
+/**************************************************************************
+** relativeDraw
+**
+** Draws short lines relative to last position.  (drawing action 0xF7)
+**************************************************************************/
+template <class Codes, bool EditState>
+void PictureRasterizer<Codes, EditState>::relativeDraw(Codes &codes)
+{
+    byte x1, y1, disp;
+    char dx, dy;
+
+    x1 = codes.next();
+    y1 = codes.next();
+
+    pset(x1, y1);
+
+    for (;;) {
+        disp = codes.next();
+        if (disp >= action_codes_start)
+            break;
+        dx = ((disp & 0xF0) >> 4) & 0x0F;
+        dy = (disp & 0x0F);
+        if (dx & 0x08)
+            dx = (-1) * (dx & 0x07);
+        if (dy & 0x08)
+            dy = (-1) * (dy & 0x07);
+        drawline(x1, y1, x1 + dx, y1 + dy);
+        x1 += dx;
+        y1 += dy;
+    }
+
+    codes.back();
+}
+
+/**************************************************************************
+** fill
+**
+** Agi flood fill.  (drawing action 0xF8)
+**************************************************************************/
+template <class Codes, bool EditState>
+void PictureRasterizer<Codes, EditState>::fill(Codes &codes)
+{
+    byte x1, y1;
+
+    for (;;) {
+        if ((x1 = codes.next()) >= action_codes_start)
+            break;
+        if ((y1 = codes.next()) >= action_codes_start)
+            break;
+        agiFill(x1, y1);
+    }
+
+    codes.back();
+}
+
+/**************************************************************************
+** absoluteLine
+**
+** Draws long lines to actual locations (cf. relative) (drawing action 0xF6)
+**************************************************************************/
+template <class Codes, bool EditState>
+void PictureRasterizer<Codes, EditState>::absoluteLine(Codes &codes)
+{
+    byte x1, y1, x2, y2;
+
+    x1 = codes.next();
+    y1 = codes.next();
+
+    pset(x1, y1);
+
+    for (;;) {
+        if ((x2 = codes.next()) >= action_codes_start)
+            break;
+        if ((y2 = codes.next()) >= action_codes_start)
+            break;
+        drawline(x1, y1, x2, y2);
+        x1 = x2;
+        y1 = y2;
+    }
+
+    codes.back();
+}
+
+
+#define plotPatternPoint() \
+   if (patCode & 0x20) { \
+      if ((splatterMap[bitPos>>3] >> (7-(bitPos&7))) & 1) pset(x1, y1); \
+      bitPos++; \
+      if (bitPos == 0xff) bitPos=0; \
+   } else pset(x1, y1)
+
+/**************************************************************************
+** plotPattern
+**
+** Draws pixels, circles, squares, or splatter brush patterns depending
+** on the pattern code.
+**************************************************************************/
+template <class Codes, bool EditState>
+void PictureRasterizer<Codes, EditState>::plotPattern(byte x, byte y)
+{
+    static byte circles[][15] = { /* agi circle bitmaps */
+        {0x80},
+        {0xfc},
+        {0x5f, 0xf4},
+        {0x66, 0xff, 0xf6, 0x60},
+        {0x23, 0xbf, 0xff, 0xff, 0xee, 0x20},
+        {0x31, 0xe7, 0x9e, 0xff, 0xff, 0xde, 0x79, 0xe3, 0x00},
+        {0x38, 0xf9, 0xf3, 0xef, 0xff, 0xff, 0xff, 0xfe, 0xf9, 0xf3, 0xe3, 0x80},
+        {0x18, 0x3c, 0x7e, 0x7e, 0x7e, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7e, 0x7e, 0x7e, 0x3c, 0x18}
+    };
+
+    static byte splatterMap[32] = { /* splatter brush bitmaps */
+        0x20, 0x94, 0x02, 0x24, 0x90, 0x82, 0xa4, 0xa2,
+        0x82, 0x09, 0x0a, 0x22, 0x12, 0x10, 0x42, 0x14,
+        0x91, 0x4a, 0x91, 0x11, 0x08, 0x12, 0x25, 0x10,
+        0x22, 0xa8, 0x14, 0x24, 0x00, 0x50, 0x24, 0x04
+    };
+
+    static byte splatterStart[128] = { /* starting bit position */
+        0x00, 0x18, 0x30, 0xc4, 0xdc, 0x65, 0xeb, 0x48,
+        0x60, 0xbd, 0x89, 0x05, 0x0a, 0xf4, 0x7d, 0x7d,
+        0x85, 0xb0, 0x8e, 0x95, 0x1f, 0x22, 0x0d, 0xdf,
+        0x2a, 0x78, 0xd5, 0x73, 0x1c, 0xb4, 0x40, 0xa1,
+        0xb9, 0x3c, 0xca, 0x58, 0x92, 0x34, 0xcc, 0xce,
+        0xd7, 0x42, 0x90, 0x0f, 0x8b, 0x7f, 0x32, 0xed,
+        0x5c, 0x9d, 0xc8, 0x99, 0xad, 0x4e, 0x56, 0xa6,
+        0xf7, 0x68, 0xb7, 0x25, 0x82, 0x37, 0x3a, 0x51,
+        0x69, 0x26, 0x38, 0x52, 0x9e, 0x9a, 0x4f, 0xa7,
+        0x43, 0x10, 0x80, 0xee, 0x3d, 0x59, 0x35, 0xcf,
+        0x79, 0x74, 0xb5, 0xa2, 0xb1, 0x96, 0x23, 0xe0,
+        0xbe, 0x05, 0xf5, 0x6e, 0x19, 0xc5, 0x66, 0x49,
+        0xf0, 0xd1, 0x54, 0xa9, 0x70, 0x4b, 0xa4, 0xe2,
+        0xe6, 0xe5, 0xab, 0xe4, 0xd2, 0xaa, 0x4c, 0xe3,
+        0x06, 0x6f, 0xc6, 0x4a, 0xa4, 0x75, 0x97, 0xe1
+    };
+
+    int circlePos = 0;
+    byte x1, y1, penSize, bitPos = splatterStart[patNum];
+
+    penSize = (patCode & 7);
+
+    if (x < ((penSize / 2) + 1))
+        x = ((penSize / 2) + 1);
+    else if (x > 160 - ((penSize / 2) + 1))
+        x = 160 - ((penSize / 2) + 1);
+    if (y < penSize)
+        y = penSize;
+    else if (y >= 168 - penSize)
+        y = 167 - penSize;
+
+    for (y1 = y - penSize; y1 <= y + penSize; y1++) {
+        for (x1 = x - ((int)ceil((float)penSize / 2)); x1 <= x + ((int)floor((float)penSize / 2)); x1++) {
+            if (patCode & 0x10)   /* Square */
+                plotPatternPoint();
+            else { /* Circle */
+                if ((circles[patCode & 7][circlePos >> 3] >> (7 - (circlePos & 7))) & 1) {
+                    plotPatternPoint();
+                }
+                circlePos++;
+            }
+        }
+    }
+}
+
+
+/**************************************************************************
+** plotBrush
+**
+** Plots points and various brush patterns.
+**************************************************************************/
+template <class Codes, bool EditState>
+void PictureRasterizer<Codes, EditState>::plotBrush(Codes &codes)
+{
+    byte x1, y1;
+
+    for (;;) {
+        if (patCode & 0x20) {
+            if ((patNum = codes.next()) >= action_codes_start)
+                break;
+            patNum = (patNum >> 1 & 0x7f);
+        }
+        if ((x1 = codes.next()) >= action_codes_start)
+            break;
+        if ((y1 = codes.next()) >= action_codes_start)
+            break;
+        plotPattern(x1, y1);
+    }
+
+    codes.back();
+}
+
+// The two interpreters: BPicture (preview) and Picture (picture editor)
+template class PictureRasterizer<PicResourceCodes, false>;
+template class PictureRasterizer<PicEditCodes, true>;
@@ -40,36 +40,37 @@ static int picColour0, priColour0;
 
 //*********************************************************
 Picture::Picture() :
-    brushSize(1), brushTexture(), brushShape(), picPos(picCodes.begin()),
-    bg_on(false), add_pic(), add_pri(), bgpix(), buf(), clickX(), clickY(),
+    brushSize(1), brushTexture(), brushShape(), picPos(), actionsIndexed(),
+    bg_on(false), add_pic(), add_pri(), bgpix(), clickX(), clickY(),
     code_pic(), code_pri(), curcol(), curp(), dX(), dY(), drawing_mode(),
-    firstClick(), newp(), numClicks(), patCode(), patNum(), picColour(),
-    picDrawEnabled(), picture(), pptr(), priColour(), priDrawEnabled(),
+    firstClick(), newp(), numClicks(), picture(), pptr(),
     priority(), refill_pic(), refill_pri(), refill_x(), refill_y(),
-    rpos(), spos(), stepClicks(), tool()
-{ }
+    stepClicks()
+{
+    tool = 0;
+    picScreen = picture;
+    priScreen = priority;
+}
 
 //*********************************************************
 const QString Picture::showPos(byte *code, byte *val) const
 //show current picture buffer position
 {
     QString codestring;
-    int count;
-    actionListIter tempIter;
 
-    if (picPos != picCodes.end()) {
-        *code = *picPos;
-        if (std::next(picPos) != picCodes.end())
-            *val = *std::next(picPos);
+    if (picPos < picCodes.size()) {
+        *code = picCodes[picPos];
+        if (picPos + 1 < picCodes.size())
+            *val = picCodes[picPos + 1];
     }
-    for (tempIter = picPos, count = 0; ((count < 6) && (tempIter != picCodes.end())); count++, tempIter++)
-        codestring += QString("%1").arg(QString::number(*tempIter, 16), 2, QChar('0'));
+    for (size_t i = picPos; i < picCodes.size() && i < picPos + 6; i++)
+        codestring += QString("%1").arg(QString::number(picCodes[i], 16), 2, QChar('0'));
     return codestring;
 }
 
 const uint32_t Picture::getPos() const
 {
-    return std::distance(picCodes.begin(), (actionList::const_iterator)picPos);
+    return (uint32_t)picPos;
 }
 
 //*********************************************************
@@ -80,527 +81,27 @@ int Picture::setBufPos(int inputValue)
         return 1;
 
     if (inputValue == picCodes.size())
-        picPos = picCodes.end();
+        picPos = picCodes.size();
     else {
-        /* Advance to requested location */
-        picPos = picCodes.begin();
-        std::advance(picPos, inputValue);
-
-        /* Walk backward to the beginning of the current action position */
-        while (*picPos < 0xF0)
-            picPos--;
+        /* Go to the beginning of the action at the requested location */
+        indexActions();
+        auto start = std::upper_bound(actionStarts.begin(), actionStarts.end(), (actionListPos)inputValue);
+        picPos = (start == actionStarts.begin()) ? 0 : *std::prev(start);
     }
     draw();
     init_tool();
     return 0;
 }
 
-//*********************************************************
-void Picture::qstore(byte q)
-{
-    if (spos + 1 == rpos || (spos + 1 == QUMAX && !rpos))
-        return;
-    buf[spos] = q;
-    spos++;
-    if (spos == QUMAX)
-        spos = 0;  /* loop back */
-}
-
-//*********************************************************
-byte Picture::qretrieve()
-{
-    if (rpos == QUMAX)
-        rpos = 0; /* loop back */
-    if (rpos == spos)
-        return EMPTY;
-    rpos++;
-    return buf[rpos - 1];
-}
-
-/**************************************************************************
-** getCode
-**
-** Gets the next picture code from the linked list.
-**************************************************************************/
-byte Picture::getCode(actionListIter *pos) const
-{
-    byte retVal;
-
-    if (*pos == picCodes.end())
-        return DrawEnd;
-
-    retVal = **pos;
-    (*pos)++;
-
-    return retVal;
-}
-
-byte Picture::testCode(actionListIter *pos) const
-{
-    if (*pos == picCodes.end())
-        return 0xFF;
-
-    return **pos;
-}
-
-
-/**************************************************************************
-** picPSet
-**
-** Draws a pixel in the picture screen.
-**************************************************************************/
-void Picture::picPSet(word x, word y)
-{
-    x <<= 1;
-    if (x >= MAX_W)
-        return;
-    if (y >= MAX_H)
-        return;
-
-    picture[y * MAX_W + x] = picColour;
-    picture[y * MAX_W + x + 1] = picColour;
-}
-
-/**************************************************************************
-** priPSet
-**
-** Draws a pixel in the priority screen.
-**************************************************************************/
-void Picture::priPSet(word x, word y)
-{
-    x <<= 1;
-    if (x >= MAX_W)
-        return;
-    if (y >= MAX_H)
-        return;
-    priority[y * MAX_W + x] = priColour;
-    priority[y * MAX_W + x + 1] = priColour;
-}
-
-/**************************************************************************
-** pset
-**
-** Draws a pixel in each screen depending on whether drawing in that
-** screen is enabled or not.
-**************************************************************************/
-void Picture::pset(word x, word y)
-{
-    if (picDrawEnabled)
-        picPSet(x, y);
-    if (priDrawEnabled)
-        priPSet(x, y);
-}
-
-/**************************************************************************
-** picGetPixel
-**
-** Get colour at x,y on the picture page.
-**************************************************************************/
-byte Picture::picGetPixel(word x, word y) const
-{
-    x <<= 1;
-    if (x >= MAX_W)
-        return 4;
-    if (y >= MAX_H)
-        return 4;
-
-    return (picture[y * MAX_W + x]);
-}
-
-/**************************************************************************
-** priGetPixel
-**
-** Get colour at x,y on the priority page.
-**************************************************************************/
-byte Picture::priGetPixel(word x, word y) const
-{
-    x <<= 1;
-    if (x >= MAX_W)
-        return 4;
-    if (y >= MAX_H)
-        return 4;
-
-    return (priority[y * MAX_W + x]);
-}
-
-/**************************************************************************
-** round
-**
-** Rounds a float to the closest int. Takes into actions which direction
-** the current line is being drawn when it has a 50:50 decision about
-** where to put a pixel.
-**************************************************************************/
-int Picture::round(float aNumber, float dirn)
-{
-    if (dirn < 0)
-        return ((aNumber - floor(aNumber) <= 0.501) ? (int)floor(aNumber) : (int)ceil(aNumber));
-    return ((aNumber - floor(aNumber) < 0.499) ? (int)floor(aNumber) : (int)ceil(aNumber));
-}
-
-/**************************************************************************
-** drawline
-**
-** Draws an AGI line.
-**************************************************************************/
-void Picture::drawline(word x1, word y1, word x2, word y2)
-{
-    int height, width;
-    float x, y, addX, addY;
-
-    height = (y2 - y1);
-    width = (x2 - x1);
-    addX = (height == 0 ? height : (float)width / abs(height));
-    addY = (width == 0 ? width : (float)height / abs(width));
-
-    if (abs(width) > abs(height)) {
-        y = y1;
-        addX = (width == 0 ? 0 : (width / abs(width)));
-        for (x = x1; x != x2; x += addX) {
-            pset(round(x, addX), round(y, addY));
-            y += addY;
-        }
-        pset(x2, y2);
-    } else {
-        x = x1;
-        addY = (height == 0 ? 0 : (height / abs(height)));
-        for (y = y1; y != y2; y += addY) {
-            pset(round(x, addX), round(y, addY));
-            x += addX;
-        }
-        pset(x2, y2);
-    }
-}
-
-/**************************************************************************
-** okToFill
-**************************************************************************/
-bool Picture::okToFill(byte x, byte y)
-{
-    if (!picDrawEnabled && !priDrawEnabled)
-        return false;
-    if (picColour == 15)
-        return false;
-    if (!priDrawEnabled)
-        return (picGetPixel(x, y) == 15);
-    if (priDrawEnabled && !picDrawEnabled)
-        return (priGetPixel(x, y) == 4);
-    return (picGetPixel(x, y) == 15);
-}
-
-/**************************************************************************
-** agiFill
-**************************************************************************/
-void Picture::agiFill(word x, word y)
-{
-    byte x1, y1;
-    rpos = spos = 0;
-
-    qstore(x);
-    qstore(y);
-
-    for (;;) {
-
-        x1 = qretrieve();
-        y1 = qretrieve();
-
-        if ((x1 == EMPTY) || (y1 == EMPTY))
-            break;
-        else {
-
-            if (okToFill(x1, y1)) {
-
-                pset(x1, y1);
-
-                if (okToFill(x1, y1 - 1) && (y1 != 0)) {
-                    qstore(x1);
-                    qstore(y1 - 1);
-                }
-                if (okToFill(x1 - 1, y1) && (x1 != 0)) {
-                    qstore(x1 - 1);
-                    qstore(y1);
-                }
-                if (okToFill(x1 + 1, y1) && (x1 != 159)) {
-                    qstore(x1 + 1);
-                    qstore(y1);
-                }
-                if (okToFill(x1, y1 + 1) && (y1 != 167)) {
-                    qstore(x1);
-                    qstore(y1 + 1);
-                }
-            }
-        }
-    }
-}
-
-/**************************************************************************
-** xCorner
-**
-** Draws an xCorner  (drawing action 0xF5)
-**************************************************************************/
-void Picture::xCorner(actionListIter *pos)
-{
-    byte x1, x2, y1, y2;
-
-    x1 = getCode(pos);
-    y1 = getCode(pos);
-
-    pset(x1, y1);
-
-    for (;;) {
-        x2 = getCode(pos);
-        if (x2 >= action_codes_start)
-            break;
-        drawline(x1, y1, x2, y1);
-        x1 = x2;
-        y2 = getCode(pos);
-        if (y2 >= action_codes_start)
-            break;
-        drawline(x1, y1, x1, y2);
-        y1 = y2;
-    }
-
-    if (*pos != picCodes.begin())
-        (*pos)--;
-}
-
-/**************************************************************************
-** yCorner
-**
-** Draws an yCorner  (drawing action 0xF4)
-**************************************************************************/
-void Picture::yCorner(actionListIter *pos)
-{
-    byte x1, x2, y1, y2;
-
-    x1 = getCode(pos);
-    y1 = getCode(pos);
-
-    pset(x1, y1);
-
-    for (;;) {
-        y2 = getCode(pos);
-        if (y2 >= action_codes_start)
-            break;
-        drawline(x1, y1, x1, y2);
-        y1 = y2;
-        x2 = getCode(pos);
-        if (x2 >= action_codes_start)
-            break;
-        drawline(x1, y1, x2, y1);
-        x1 = x2;
-    }
-
-    if (*pos != picCodes.begin())
-        (*pos)--;
-}
-
-/**************************************************************************
-** relativeDraw
-**
-** Draws short lines relative to last position.  (drawing action 0xF7)
-**************************************************************************/
-void Picture::relativeDraw(actionListIter *pos)
-{
-    byte x1, y1, disp;
-    char dx, dy;
-
-    x1 = getCode(pos);
-    y1 = getCode(pos);
-
-    pset(x1, y1);
-
-    for (;;) {
-        disp = getCode(pos);
-        if (disp >= action_codes_start)
-            break;
-        dx = ((disp & 0xF0) >> 4) & 0x0F;
-        dy = (disp & 0x0F);
-        if (dx & 0x08)
-            dx = (-1) * (dx & 0x07);
-        if (dy & 0x08)
-            dy = (-1) * (dy & 0x07);
-        drawline(x1, y1, x1 + dx, y1 + dy);
-        x1 += dx;
-        y1 += dy;
-    }
-
-    if (*pos != picCodes.begin())
-        (*pos)--;
-}
-
-/**************************************************************************
-** fill
-**
-** AGI flood fill.  (drawing action 0xF8)
-**************************************************************************/
-void Picture::fill(actionListIter *pos)
-{
-    byte x1, y1;
-
-    for (;;) {
-        if ((x1 = getCode(pos)) >= action_codes_start)
-            break;
-        if ((y1 = getCode(pos)) >= action_codes_start)
-            break;
-        agiFill(x1, y1);
-    }
-
-    if (*pos != picCodes.end())
-        (*pos)--;
-}
-
-/**************************************************************************
-** absoluteLine
-**
-** Draws long lines to actual locations (cf. relative) (drawing action 0xF6)
-**************************************************************************/
-void Picture::absoluteLine(actionListIter *pos)
-{
-    byte x1, y1, x2, y2;
-
-    x1 = getCode(pos);
-    y1 = getCode(pos);
-
-    pset(x1, y1);
-
-    for (;;) {
-        if ((x2 = getCode(pos)) >= action_codes_start)
-            break;
-        if ((y2 = getCode(pos)) >= action_codes_start)
-            break;
-        drawline(x1, y1, x2, y2);
-        x1 = x2;
-        y1 = y2;
-    }
-
-    if (*pos != picCodes.begin())
-        (*pos)--;
-}
-
-
-#define plotPatternPoint() \
-   if (patCode & 0x20) { \
-      if ((splatterMap[bitPos>>3] >> (7-(bitPos&7))) & 1) pset(x1, y1); \
-      bitPos++; \
-      if (bitPos == 0xff) bitPos=0; \
-   } else pset(x1, y1)
-
-/**************************************************************************
-** plotPattern
-**
-** Draws pixels, circles, squares, or splatter brush patterns depending
-** on the pattern code.
-**************************************************************************/
-void Picture::plotPattern(byte x, byte y)
-{
-    static byte circles[][15] = { /* agi circle bitmaps */
-        {0x80},
-        {0xfc},
-        {0x5f, 0xf4},
-        {0x66, 0xff, 0xf6, 0x60},
-        {0x23, 0xbf, 0xff, 0xff, 0xee, 0x20},
-        {0x31, 0xe7, 0x9e, 0xff, 0xff, 0xde, 0x79, 0xe3, 0x00},
-        {0x38, 0xf9, 0xf3, 0xef, 0xff, 0xff, 0xff, 0xfe, 0xf9, 0xf3, 0xe3, 0x80},
-        {0x18, 0x3c, 0x7e, 0x7e, 0x7e, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7e, 0x7e, 0x7e, 0x3c, 0x18}
-    };
-
-    static byte splatterMap[32] = { /* splatter brush bitmaps */
-        0x20, 0x94, 0x02, 0x24, 0x90, 0x82, 0xa4, 0xa2,
-        0x82, 0x09, 0x0a, 0x22, 0x12, 0x10, 0x42, 0x14,
-        0x91, 0x4a, 0x91, 0x11, 0x08, 0x12, 0x25, 0x10,
-        0x22, 0xa8, 0x14, 0x24, 0x00, 0x50, 0x24, 0x04
-    };
-
-    static byte splatterStart[128] = { /* starting bit position */
-        0x00, 0x18, 0x30, 0xc4, 0xdc, 0x65, 0xeb, 0x48,
-        0x60, 0xbd, 0x89, 0x05, 0x0a, 0xf4, 0x7d, 0x7d,
-        0x85, 0xb0, 0x8e, 0x95, 0x1f, 0x22, 0x0d, 0xdf,
-        0x2a, 0x78, 0xd5, 0x73, 0x1c, 0xb4, 0x40, 0xa1,
-        0xb9, 0x3c, 0xca, 0x58, 0x92, 0x34, 0xcc, 0xce,
-        0xd7, 0x42, 0x90, 0x0f, 0x8b, 0x7f, 0x32, 0xed,
-        0x5c, 0x9d, 0xc8, 0x99, 0xad, 0x4e, 0x56, 0xa6,
-        0xf7, 0x68, 0xb7, 0x25, 0x82, 0x37, 0x3a, 0x51,
-        0x69, 0x26, 0x38, 0x52, 0x9e, 0x9a, 0x4f, 0xa7,
-        0x43, 0x10, 0x80, 0xee, 0x3d, 0x59, 0x35, 0xcf,
-        0x79, 0x74, 0xb5, 0xa2, 0xb1, 0x96, 0x23, 0xe0,
-        0xbe, 0x05, 0xf5, 0x6e, 0x19, 0xc5, 0x66, 0x49,
-        0xf0, 0xd1, 0x54, 0xa9, 0x70, 0x4b, 0xa4, 0xe2,
-        0xe6, 0xe5, 0xab, 0xe4, 0xd2, 0xaa, 0x4c, 0xe3,
-        0x06, 0x6f, 0xc6, 0x4a, 0xa4, 0x75, 0x97, 0xe1
-    };
-
-    int circlePos = 0;
-    byte x1, y1, penSize, bitPos = splatterStart[patNum];
-
-    penSize = (patCode & 7);
-
-    if (x < ((penSize / 2) + 1))
-        x = ((penSize / 2) + 1);
-    else if (x > 160 - ((penSize / 2) + 1))
-        x = 160 - ((penSize / 2) + 1);
-    if (y < penSize)
-        y = penSize;
-    else if (y >= 168 - penSize)
-        y = 167 - penSize;
-
-    for (y1 = y - penSize; y1 <= y + penSize; y1++) {
-        for (x1 = x - ((int)ceil((float)penSize / 2)); x1 <= x + ((int)floor((float)penSize / 2)); x1++) {
-            if (patCode & 0x10)   /* Square */
-                plotPatternPoint();
-            else { /* Circle */
-                if ((circles[patCode & 7][circlePos >> 3] >> (7 - (circlePos & 7))) & 1) {
-                    plotPatternPoint();
-                }
-                circlePos++;
-            }
-        }
-    }
-
-}
-
-
-/**************************************************************************
-** plotBrush
-**
-** Plots points and various brush patterns.
-**************************************************************************/
-void Picture::plotBrush(actionListIter *pos)
-{
-    byte x1, y1;
-
-    for (;;) {
-        if (patCode & 0x20) {
-            if ((patNum = getCode(pos)) >= action_codes_start)
-                break;
-            patNum = (patNum >> 1 & 0x7f);
-        }
-        if ((x1 = getCode(pos)) >= action_codes_start)
-            break;
-        if ((y1 = getCode(pos)) >= action_codes_start)
-            break;
-        plotPattern(x1, y1);
-    }
-
-    if (*pos != picCodes.begin())
-        (*pos)--;
-}
-
 //********************************************************************
 void Picture::load(byte *picdata, int picsize)
 {
-    byte nodeData;
+    byte *end = std::find(picdata, picdata + std::max(picsize, 0), DrawEnd);
 
-    picCodes.clear();
-
-    do {
-        nodeData = *picdata++;
-        picsize--;
-        if (nodeData != DrawEnd)
-            picCodes.emplace_back(nodeData);
-        else
-            break;
-
-    } while (picsize);
+    picCodes.assign(picdata, end);
+    picPos = picCodes.size();
+    actionsIndexed = false;
+    snapshots.clear();
 }
 
 //*************************************************
@@ -670,20 +171,24 @@ void Picture::save()
         return;
     }
 
-    for (const auto &picCode : picCodes)
-        *ptr++ = picCode;
+    ptr = std::copy(picCodes.begin(), picCodes.end(), ptr);
 
     *ptr++ = action_codes_end; /* End of picture marker */
     ResourceData.Size = (int)(ptr - ResourceData.Data);
 }
 
 //*************************************************
-void Picture::refill(actionListIter pos_fill_start, actionListIter pos_fill_end, int refmode)
+void Picture::refill(actionListPos pos_fill_start, actionListPos pos_fill_end, int refmode)
 {
-    actionListIter pos, picPos0, temp_pic, temp_pri;
+    actionListPos pos, picPos0, temp_pic = 0, temp_pri = 0;
     int col_pic_orig, col_pri_orig, col_pic_new, col_pri_new;
     bool picDrawEnabled_orig, priDrawEnabled_orig;
     bool draw_pic_orig, draw_pri_orig, draw_pic_new, draw_pri_new;
+    size_t held = heldPos.size();
+
+    snapshots.clear();  // the picture is changed before picPos
+    // keep these on the same codes while codes are added and deleted below
+    heldPos.insert(heldPos.end(), {&pos_fill_end, &picPos0, &temp_pic, &temp_pri});
 
     picDrawEnabled_orig = priDrawEnabled_orig = false;
     col_pic_orig = col_pri_orig = -1;
@@ -691,13 +196,13 @@ void Picture::refill(actionListIter pos_fill_start, actionListIter pos_fill_end,
     draw_pic_orig = draw_pri_orig = false;
 
     do {
-        if (pos == picCodes.begin())
+        if (pos == 0)
             break;
         pos--;
-        switch (*pos) {
+        switch (picCodes[pos]) {
             case SetPicColor:
                 if (col_pic_orig == -1) {
-                    col_pic_orig = *std::next(pos);
+                    col_pic_orig = picCodes[pos + 1];
                     picDrawEnabled_orig = true;
                     temp_pic = pos;
                 }
@@ -710,7 +215,7 @@ void Picture::refill(actionListIter pos_fill_start, actionListIter pos_fill_end,
                 break;
             case SetPriColor:
                 if (col_pri_orig == -1) {
-                    col_pri_orig = *std::next(pos);
+                    col_pri_orig = picCodes[pos + 1];
                     priDrawEnabled_orig = true;
                     temp_pri = pos;
                 }
@@ -722,7 +227,7 @@ void Picture::refill(actionListIter pos_fill_start, actionListIter pos_fill_end,
                 }
                 break;
             default:
-                if (*pos >= YCorner && *pos < DrawEnd) {
+                if (picCodes[pos] >= YCorner && picCodes[pos] < DrawEnd) {
                     if (col_pic_orig == -1)
                         draw_pic_orig = true;
                     if (col_pri_orig == -1)
@@ -742,8 +247,8 @@ void Picture::refill(actionListIter pos_fill_start, actionListIter pos_fill_end,
                     if (draw_pic_orig)
                         addCode(EnablePriority);
                     else {
-                        *temp_pic = EnablePriority;
-                        picPos = std::next(temp_pic);
+                        picCodes[temp_pic] = EnablePriority;
+                        picPos = temp_pic + 1;
                         dldelete();
                     }
                 } else { //col_pic != 15
@@ -751,7 +256,7 @@ void Picture::refill(actionListIter pos_fill_start, actionListIter pos_fill_end,
                         addCode(SetPicColor);
                         addCode(col_pic);
                     } else
-                        *std::next(temp_pic) = col_pic;
+                        picCodes[temp_pic + 1] = col_pic;
                 }
             }
         } else { //!picDrawEnabled_orig
@@ -769,8 +274,8 @@ void Picture::refill(actionListIter pos_fill_start, actionListIter pos_fill_end,
                     if (draw_pri_orig)
                         addCode(EnableVisual);
                     else {
-                        *temp_pri = EnableVisual;
-                        picPos = std::next(temp_pri);
+                        picCodes[temp_pri] = EnableVisual;
+                        picPos = temp_pri + 1;
                         dldelete();
                     }
                 } else { //col_pri != 4
@@ -778,7 +283,7 @@ void Picture::refill(actionListIter pos_fill_start, actionListIter pos_fill_end,
                         addCode(SetPriColor);
                         addCode(col_pri);
                     } else
-                        *std::next(temp_pri) = col_pri;
+                        picCodes[temp_pri + 1] = col_pri;
                 }
             }
         } else { //!priDrawEnabled_orig
@@ -792,23 +297,23 @@ void Picture::refill(actionListIter pos_fill_start, actionListIter pos_fill_end,
     pos = pos_fill_end;
     col_pic_new = col_pri_new = -1;
     draw_pic_new = draw_pri_new = false;
-    if (pos != picCodes.end()) {
+    if (pos != picCodes.size()) {
         do {
-            switch (*pos) {
+            switch (picCodes[pos]) {
                 case SetPicColor:
-                    col_pic_new = *std::next(pos);
+                    col_pic_new = picCodes[pos + 1];
                     break;
                 case EnablePriority:
                     col_pic_new = -2;
                     break;
                 case SetPriColor:
-                    col_pri_new = *std::next(pos);
+                    col_pri_new = picCodes[pos + 1];
                     break;
                 case EnableVisual:
                     col_pri_new = -2;
                     break;
                 default:
-                    if (*pos >= YCorner && *pos < DrawEnd) {
+                    if (picCodes[pos] >= YCorner && picCodes[pos] < DrawEnd) {
                         if (col_pic_new == -1)
                             draw_pic_new = true;
                         if (col_pri_new == -1)
@@ -817,7 +322,7 @@ void Picture::refill(actionListIter pos_fill_start, actionListIter pos_fill_end,
                     break;
             }
             pos++;
-        } while ((pos != picCodes.end()) && (col_pic_orig == -1 || col_pri_orig == -1));
+        } while ((pos != picCodes.size()) && (col_pic_orig == -1 || col_pri_orig == -1));
 
 
         picPos = pos_fill_end;
@@ -850,114 +355,123 @@ void Picture::refill(actionListIter pos_fill_start, actionListIter pos_fill_end,
         }
 
     }
+    heldPos.resize(held);
     picPos = picPos0;
     draw();
 }
 
 //*************************************************
+void Picture::saveSnapshot(size_t pos)
+{
+    TPicSnapshot snapshot;
+
+    snapshot.Pos = pos;
+    snapshot.picture.assign(picture, picture + PIC_W * MAX_H);
+    snapshot.priority.assign(priority, priority + PIC_W * MAX_H);
+    snapshot.picDrawEnabled = picDrawEnabled;
+    snapshot.priDrawEnabled = priDrawEnabled;
+    snapshot.picColour = picColour;
+    snapshot.priColour = priColour;
+    snapshot.patCode = patCode;
+    snapshot.patNum = patNum;
+    snapshot.tool = tool;
+    snapshots.push_back(std::move(snapshot));
+}
+
+//*************************************************
+void Picture::restoreSnapshot(const TPicSnapshot &snapshot)
+{
+    std::copy(snapshot.picture.begin(), snapshot.picture.end(), picture);
+    std::copy(snapshot.priority.begin(), snapshot.priority.end(), priority);
+    picDrawEnabled = snapshot.picDrawEnabled;
+    priDrawEnabled = snapshot.priDrawEnabled;
+    picColour = snapshot.picColour;
+    priColour = snapshot.priColour;
+    patCode = snapshot.patCode;
+    patNum = snapshot.patNum;
+    tool = snapshot.tool;
+    changed = {0, 0, PIC_W - 1, MAX_H - 1};
+}
+
+//*************************************************
+// The picture is about to change at 'pos': forget the snapshots taken there
+// or later. (An insertion at 'pos' may add to the action before it, so 'pos'
+// is no longer known to be the start of an action.)
+void Picture::invalidateSnapshots(size_t pos)
+{
+    while (!snapshots.empty() && snapshots.back().Pos >= pos)
+        snapshots.pop_back();
+}
+
+//*************************************************
+// Draw the picture up to picPos, starting from the last snapshot before it.
 void Picture::draw()
 {
     byte action;
-    actionListIter pos, pos_fill_start, pos_fill_end;
+    actionListPos pos_fill_start, pos_fill_end;
     int refmode;
     bool finishedPic = false;
     int pC, pN;
+    int actions = 0;
+
+    // refill() changes the picture while it is being drawn, so it is
+    // always drawn from the start and no snapshots are taken
+    bool refilling = (refill_pic || refill_pri);
+    if (refilling)
+        snapshots.clear();
+
+    pC = patCode;
+    pN = patNum;
+
+    PicEditCodes codes(picCodes, 0);
+    auto snapshot = snapshots.rbegin();
+    while (snapshot != snapshots.rend() && snapshot->Pos > picPos)
+        snapshot++;
+    if (snapshot != snapshots.rend()) {
+        restoreSnapshot(*snapshot);
+        codes.pos = snapshot->Pos;
+    } else {
+        clear();
+        tool = -1;
+    }
 
-    memset(picture, 15, MAX_W * MAX_H); /* Visual screen default, white */
-    memset(priority, 4, MAX_W * MAX_H); /* Priority screen default, red */
-    rpos = QUMAX;
-    spos = 0;
-    picDrawEnabled = false;
-    priDrawEnabled = false;
-    picColour = priColour = 0;
-    tool = -1;
-
-    if (!picCodes.empty()) {
-
-        pC = patCode;
-        pN = patNum;
-        patCode = patNum = 0;
-
-        pos = picCodes.begin();
-
-        if (picPos != picCodes.begin())
-            do {
-                action = getCode(&pos);
-
-                switch (action) {
-
-                    case SetPicColor:
-                        picColour = getCode(&pos);
-                        picDrawEnabled = true;
-                        break;
-                    case EnablePriority:
-                        picDrawEnabled = false;
-                        break;
-                    case SetPriColor:
-                        priColour = getCode(&pos);
-                        priDrawEnabled = true;
-                        break;
-                    case EnableVisual:
-                        priDrawEnabled = false;
-                        break;
-                    case YCorner:
-                        tool = T_STEP;
-                        yCorner(&pos);
-                        break;
-                    case XCorner:
-                        tool = T_STEP;
-                        xCorner(&pos);
-                        break;
-                    case AbsoluteLine:
-                        tool = T_LINE;
-                        absoluteLine(&pos);
-                        break;
-                    case RelativeLine:
-                        tool = T_PEN;
-                        relativeDraw(&pos);
-                        break;
-                    case Fill:
-                        tool = T_FILL;
-                        pos_fill_start = std::prev(pos);
-                        fill(&pos);
-                        pos_fill_end = pos;
-                        if (refill_pic || refill_pri) {
-                            //find which FILL filled the selected area
-                            refmode = 0;
-                            if (refill_pic && picGetPixel(refill_x, refill_y) != 15) {
-                                refmode |= 1;
-                                refill_pic = false;
-                            }
-                            if (refill_pri && priGetPixel(refill_x, refill_y) != 4) {
-                                refill_pri = false;
-                                refmode |= 2;
-                            }
-                            if (refmode)
-                                refill(pos_fill_start, pos_fill_end, refmode);
-                            if (!refill_pic && !refill_pri)
-                                return;
-                        }
-                        break;
-                    case SetPattern:
-                        patCode = getCode(&pos);
-                        break;
-                    case Brush:
-                        tool = T_BRUSH;
-                        plotBrush(&pos);
-                        break;
-                    case DrawEnd:
-                        finishedPic = true;
-                        break;
-                    default:
-                        printf("Unknown picture code : %X", action);
-                        break;
-                }
-
-            } while ((pos != picPos) && !finishedPic);
+    while ((codes.pos != picPos) && !finishedPic) {
+        action = codes.next();
+        pos_fill_start = codes.pos - 1;
+        finishedPic = !drawAction(action, codes);
+
+        if (action == Fill && (refill_pic || refill_pri)) {
+            //find which FILL filled the selected area
+            pos_fill_end = codes.pos;
+            refmode = 0;
+            if (refill_pic && picGetPixel(refill_x, refill_y) != 15) {
+                refmode |= 1;
+                refill_pic = false;
+            }
+            if (refill_pri && priGetPixel(refill_x, refill_y) != 4) {
+                refill_pri = false;
+                refmode |= 2;
+            }
+            if (refmode) {
+                heldPos.push_back(&codes.pos);
+                refill(pos_fill_start, pos_fill_end, refmode);
+                heldPos.pop_back();
+            }
+            if (!refill_pic && !refill_pri)
+                return;
+        }
 
-        patCode = pC;
-        patNum = pN;
+        // take a snapshot at the start of every PicSnapshotInterval'th action
+        // past the last one
+        if (!refilling && codes.pos < picCodes.size() && picCodes[codes.pos] >= action_codes_start &&
+                ++actions % PicSnapshotInterval == 0) {
+            if (snapshots.empty() || codes.pos > snapshots.back().Pos)
+                saveSnapshot(codes.pos);
+        }
     }
+
+    patCode = pC;
+    patNum = pN;
 }
 
 //**************************************************
@@ -966,18 +480,23 @@ void Picture::dldelete()
 {
     // Remove the node currently pointed to by picPos.
 
-    if (picPos == picCodes.end())
+    if (picPos == picCodes.size())
         return;
-    picPos = picCodes.erase(picPos);
+    invalidateSnapshots(picPos);
+    picCodes.erase(picCodes.begin() + picPos);
+    actionsIndexed = false;
+    for (actionListPos *pos : heldPos)
+        if (*pos > picPos)
+            (*pos)--;
 }
 
 void Picture::removeAction()
 {
     // Remove all nodes up to, but not including, the next action.
 
-    if (picPos != picCodes.end()) {
+    if (picPos != picCodes.size()) {
         dldelete();
-        while ((picPos != picCodes.end()) && (*picPos < action_codes_start))
+        while ((picPos != picCodes.size()) && (picCodes[picPos] < action_codes_start))
             dldelete();
     }
 }
@@ -986,40 +505,50 @@ void Picture::wipeAction()
 {
     // Remove all nodes up to the end of the list.
 
-    if (picPos != picCodes.end()) {
-        dldelete();
-        while (picPos != picCodes.end())
-            dldelete();
+    if (picPos != picCodes.size()) {
+        invalidateSnapshots(picPos);
+        picCodes.resize(picPos);
+        actionsIndexed = false;
+        for (actionListPos *pos : heldPos)
+            *pos = std::min(*pos, picPos);
     }
 }
 
 void Picture::moveBackAction()
 {
-    if (picCodes.empty() || (picPos == picCodes.begin()))
+    if (picCodes.empty() || (picPos == 0))
         return;
 
-    // Back up until we find the previous Action code.
-    do {
-        if (picPos != picCodes.begin())
-            picPos--;
-        else
-            break;
-    } while (*picPos < action_codes_start);
+    // Back up to the previous Action code.
+    indexActions();
+    auto start = std::lower_bound(actionStarts.begin(), actionStarts.end(), picPos);
+    picPos = (start == actionStarts.begin()) ? 0 : *std::prev(start);
 }
 
 void Picture::moveForwardAction()
 {
-    if (picCodes.empty() || (picPos == picCodes.end()))
+    if (picCodes.empty() || (picPos == picCodes.size()))
         return;
 
-    // Look ahead until we find the next Action code.
-    auto searchPos = std::next(picPos);
-    while (searchPos != picCodes.end()) {
-        if (*searchPos >= action_codes_start)
-            break;
-        searchPos++;
-    }
-    picPos = searchPos;
+    // Look ahead to the next Action code.
+    indexActions();
+    auto start = std::upper_bound(actionStarts.begin(), actionStarts.end(), picPos);
+    picPos = (start == actionStarts.end()) ? picCodes.size() : *start;
+}
+
+//**************************************************
+// Find the offsets of all action codes, if the picture has changed since
+// it was last done.
+void Picture::indexActions()
+{
+    if (actionsIndexed)
+        return;
+
+    actionStarts.clear();
+    for (actionListPos pos = 0; pos < picCodes.size(); pos++)
+        if (picCodes[pos] >= action_codes_start)
+            actionStarts.push_back(pos);
+    actionsIndexed = true;
 }
 
 //**************************************************
@@ -1038,22 +567,31 @@ void Picture::init()
 void Picture::newpic()
 {
     picCodes.clear();
-    picPos = picCodes.begin();
+    actionsIndexed = false;
+    snapshots.clear();
+    picPos = 0;
     draw();
     init();
 }
 
 //**************************************************
+// Insert a code before picPos; picPos stays on the code it was on.
 void Picture::addCode(byte code)
 {
-    picCodes.insert(picPos, code);
+    invalidateSnapshots(picPos);
+    picCodes.insert(picCodes.begin() + picPos, code);
+    actionsIndexed = false;
+    for (actionListPos *pos : heldPos)
+        if (*pos >= picPos)
+            (*pos)++;
+    picPos++;
 }
 
 //**************************************************
 void Picture::replaceCode(byte code)
 {
-    picCodes.insert(picPos, code);
-    picPos = picCodes.erase(picPos);
+    addCode(code);
+    dldelete();
 }
 
 //**************************************************
@@ -1102,7 +640,7 @@ void Picture::init_tool()
 //**************************************************
 void Picture::home_proc()
 {
-    picPos = picCodes.begin();
+    picPos = 0;
     draw();
     init_tool();
 }
@@ -1126,7 +664,7 @@ void Picture::right_proc()
 //**************************************************
 void Picture::end_proc()
 {
-    picPos = picCodes.end();
+    picPos = picCodes.size();
     draw();
     init_tool();
 }
@@ -1454,16 +992,16 @@ void Picture::putpix2(int x, int y)
     byte c;
     QColor cc;
 
-    if (x < 0 || y < 0 || x >= MAX_W || y >= MAX_HH)
+    if (x < 0 || y < 0 || x >= PIC_W || y >= MAX_HH)
         return;
 
     //save the pixels under the line to be drawn
     //so it can be restored when the line is moved
     if (bg_on) { //if background is on - must save the contents of the background image
+        c = pptr[y * PIC_W + x];
         x <<= 1;
         curp->p[curp->n].x = x;
         curp->p[curp->n].y = y;
-        c = pptr[y * MAX_W + x];
         if ((c == 15 && pptr == picture) || (c == 4 && pptr == priority)) {
             curp->p[curp->n].cc = QColor(bgpix->pixel(x, y));
             curp->n++;
@@ -1484,7 +1022,7 @@ void Picture::putpix2(int x, int y)
     } else { //save the pixels
         curp->p[curp->n].x = x;
         curp->p[curp->n].y = y;
-        curp->p[curp->n].c = pptr[y * MAX_W + (x << 1)];
+        curp->p[curp->n].c = pptr[y * PIC_W + x];
         curp->n++;
     }
     newp->p[newp->n].x = x;
@@ -1496,34 +1034,12 @@ void Picture::putpix2(int x, int y)
 //***************************************************
 void Picture::normline2(int x1, int y1, int x2, int y2)
 {
-    int height, width;
-    float x, y, addX, addY;
-
-    height = (y2 - y1);
-    width = (x2 - x1);
-    addX = (height == 0 ? height : (float)width / abs(height));
-    addY = (width == 0 ? width : (float)height / abs(width));
-
     points.n = 0;
     curp->n = 0;
 
-    if (abs(width) > abs(height)) {
-        y = y1;
-        addX = (width == 0 ? 0 : (width / abs(width)));
-        for (x = x1; x != x2; x += addX) {
-            putpix2(round(x, addX), round(y, addY));
-            y += addY;
-        }
-        putpix2(x2, y2);
-    } else {
-        x = x1;
-        addY = (height == 0 ? 0 : (height / abs(height)));
-        for (y = y1; y != y2; y += addY) {
-            putpix2(round(x, addX), round(y, addY));
-            x += addX;
-        }
-        putpix2(x2, y2);
-    }
+    agiLine(x1, y1, x2, y2, [this](int x, int y) {
+        putpix2(x, y);
+    });
 
     if (curp == &points0)
         curp = (&points1);
@@ -22,7 +22,8 @@
 #define PICTURE_H
 
 
-#include <list>
+#include <cstdlib>
+#include <vector>
 
 #include <QColor>
 
@@ -34,6 +35,8 @@ class QString;
 #define MAX_H 200
 #define MAX_HH 168
 //the actual height of the picture is 168 (to leave space for menu and text input)
+#define PIC_W 160
+//the picture screens are PIC_W wide; each pixel is shown twice (MAX_W wide)
 
 typedef unsigned short int word;
 typedef uint8_t byte;
@@ -52,9 +55,6 @@ typedef uint8_t byte;
 #define T_FILL 3
 #define T_BRUSH 4
 
-#define QUMAX 4000
-#define EMPTY 0xFF
-
 enum draw_code {
     SetPicColor     = 0xF0,
     EnablePriority  = 0xF1,
@@ -87,52 +87,168 @@ typedef struct {
     Point p[370];
 } Points;
 
+// start of a line still to be filled by agiFill()
+typedef struct {
+    byte x, y;
+} TFillPoint;
 
-//bitmap picture - for preview
-class BPicture
+// area of the picture screens, in picture coordinates
+typedef struct {
+    int x1, y1, x2, y2;  // inclusive; the area is empty if x1 > x2
+} TPicRect;
+
+// Draws an AGI line with plot(x, y). The pixels are those of the original
+// code, which stepped along the longer axis and rounded the other one in
+// floating point: a fraction was rounded up from 0.499 when going right or
+// down, and from just over 0.501 when going left or up.
+template <typename Plot>
+void agiLine(int x1, int y1, int x2, int y2, Plot plot)
+{
+    int width = x2 - x1, height = y2 - y1;
+    bool xmajor = (abs(width) > abs(height));
+    int steps = xmajor ? abs(width) : abs(height);
+    int delta = xmajor ? height : width;       // change of the other coordinate
+    int minor = xmajor ? y1 : x1, frac = 0;    // the other coordinate is minor + frac / steps
+    int up = (delta < 0) ? (501 * steps) / 1000 + 1 : (499 * steps + 999) / 1000;
+
+    for (int i = 0; i < steps; i++) {
+        int m = minor + (frac >= up);
+        if (xmajor)
+            plot(x1 + (width > 0 ? i : -i), m);
+        else
+            plot(m, y1 + (height > 0 ? i : -i));
+        frac += delta;
+        if (frac >= steps) {
+            frac -= steps;
+            minor++;
+        } else if (frac < 0) {
+            frac += steps;
+            minor--;
+        }
+    }
+    plot(x2, y2);
+}
+
+
+typedef std::vector<byte> actionList;
+typedef size_t actionListPos;  // offset of a code in an actionList
+
+// Picture codes as they are stored in a PICTURE resource, for PictureRasterizer.
+// Reading past the end gives DrawEnd.
+class PicResourceCodes
 {
 public:
-    BPicture();
-    byte **picture;
-    byte **priority;
-    void show(byte *, int);
-protected:
+    PicResourceCodes(const byte *data, size_t size) :
+        data(data), size(size), pos(0)
+    { }
+    byte next()
+    {
+        return (pos++ < size) ? data[pos - 1] : DrawEnd;
+    }
+    void back()
+    {
+        pos--;
+    }
+    const byte *data;
+    size_t size, pos;
+};
+
+// Picture codes being edited (Picture::picCodes), for PictureRasterizer.
+// Reading past the end gives DrawEnd.
+class PicEditCodes
+{
+public:
+    PicEditCodes(const actionList &codes, actionListPos pos) :
+        codes(codes), pos(pos)
+    { }
+    byte next()
+    {
+        return (pos++ < codes.size()) ? codes[pos - 1] : DrawEnd;
+    }
+    void back()
+    {
+        pos--;
+    }
+    const actionList &codes;
+    actionListPos pos;
+};
 
-    byte buf[QUMAX + 1];
-    word rpos, spos;
+// AGI picture interpreter used by both BPicture and Picture. Codes is where
+// the picture codes are read from (PicResourceCodes or PicEditCodes); with
+// EditState, 'tool' is set to the tool of each drawing action and 'changed'
+// grows to cover each pixel drawn.
+// The screens are MAX_H rows of PIC_W bytes, one for each picture pixel.
+template <class Codes, bool EditState>
+class PictureRasterizer
+{
+public:
+    PictureRasterizer();
     bool picDrawEnabled, priDrawEnabled;
     byte picColour, priColour, patCode, patNum;
+    int tool;  // tool of the last drawing action (kept up to date with EditState only)
+    TPicRect changed;  // pixels drawn since the last resetChanged() (EditState only)
+    void resetChanged();
+protected:
+    byte *picScreen;    // visual screen
+    byte *priScreen;    // priority screen
+    std::vector<TFillPoint> fillStack;
 
-    void qstore(byte q);
-    byte qretrieve();
+    void clear();
+    void markChanged(int x1, int x2, int y);
+    bool drawAction(byte action, Codes &codes);
     void picPSet(word x, word y);
     void priPSet(word x, word y);
     void pset(word x, word y);
     byte picGetPixel(word x, word y) const;
     byte priGetPixel(word x, word y) const;
-    int round(float aNumber, float dirn);
     void drawline(word x1, word y1, word x2, word y2);
     bool okToFill(byte x, byte y);
     void agiFill(word x, word y);
-    void xCorner(byte **data);
-    void yCorner(byte **data);
-    void relativeDraw(byte **data);
-    void fill(byte **data);
-    void absoluteLine(byte **data);
+    void xCorner(Codes &codes);
+    void yCorner(Codes &codes);
+    void relativeDraw(Codes &codes);
+    void fill(Codes &codes);
+    void absoluteLine(Codes &codes);
     void plotPattern(byte x, byte y);
-    void plotBrush(byte **data);
+    void plotBrush(Codes &codes);
+};
+
+//bitmap picture - for preview
+class BPicture : public PictureRasterizer<PicResourceCodes, false>
+{
+public:
+    BPicture();
+    ~BPicture();
+    BPicture(const BPicture &) = delete;
+    BPicture &operator=(const BPicture &) = delete;
+    static constexpr int stride = PIC_W;  // offset from one row of a screen to the next
+    byte *picture;
+    byte *priority;
+    void show(const byte *, int);
 };
 
-typedef std::list<byte> actionList;
-typedef std::list<byte>::iterator actionListIter;
+// the visible part of a picture screen, ready to be drawn
+QImage picture_image(const byte *screen, int stride, const QImage *bg = nullptr, byte empty = 15);
+
+#define PicSnapshotInterval 64  // actions between two snapshots of the picture being edited
+
+// The screens and drawing state part way through a picture, so that
+// Picture::draw() doesn't have to draw the picture from the start
+typedef struct {
+    actionListPos Pos;                // offset of the first action not drawn yet
+    std::vector<byte> picture, priority;
+    bool picDrawEnabled, priDrawEnabled;
+    byte picColour, priColour, patCode, patNum;
+    int tool;
+} TPicSnapshot;
 
 //'list' format picture - for edit
-class Picture
+class Picture : public PictureRasterizer<PicEditCodes, true>
 {
 public:
     Picture();
-    byte picture[MAX_W * MAX_H];
-    byte priority[MAX_W * MAX_H];
+    byte picture[PIC_W * MAX_H];
+    byte priority[PIC_W * MAX_H];
     byte *pptr;
     bool bg_on;
     QImage *bgpix;
@@ -166,50 +282,33 @@ public:
     int setBufPos(int);
     void viewData(QStringList *data);
     void status(int mode);
-    void refill(actionListIter pos_fill_start, actionListIter pos_fill_end, int mode);
+    void refill(actionListPos pos_fill_start, actionListPos pos_fill_end, int mode);
     int drawing_mode;
-    int tool;
     int brushSize, brushShape, brushTexture;
-    byte picColour, priColour, patCode, patNum, curcol;
-    bool picDrawEnabled, priDrawEnabled;
+    byte curcol;
     bool refill_pic, refill_pri;
     int refill_x, refill_y;
 protected:
     actionList picCodes;
-    actionListIter picPos;
+    actionListPos picPos;
+    std::vector<actionListPos> actionStarts;  // offsets of the action codes in picCodes
+    bool actionsIndexed;                      // actionStarts is up to date
+    std::vector<actionListPos *> heldPos;     // positions moved along by addCode() and dldelete()
+    std::vector<TPicSnapshot> snapshots;  // sorted by Pos, every PicSnapshotInterval actions
 
-    byte buf[QUMAX + 1];
-    word rpos, spos;
     bool add_pic, add_pri;
     int  code_pic, col_pic, code_pri, col_pri;
 
+    void indexActions();
+    void saveSnapshot(size_t pos);
+    void restoreSnapshot(const TPicSnapshot &snapshot);
+    void invalidateSnapshots(size_t pos);
     void dldelete();
     void removeAction();
     void wipeAction();
     void moveBackAction();
     void moveForwardAction();
 
-    byte getCode(actionListIter *pos) const;
-    byte testCode(actionListIter *pos) const;
-
-    void qstore(byte q);
-    byte qretrieve();
-    void picPSet(word x, word y);
-    void priPSet(word x, word y);
-    void pset(word x, word y);
-    byte picGetPixel(word x, word y) const;
-    byte priGetPixel(word x, word y) const;
-    int round(float aNumber, float dirn);
-    void drawline(word x1, word y1, word x2, word y2);
-    bool okToFill(byte x, byte y);
-    void agiFill(word x, word y);
-    void xCorner(actionListIter *pos);
-    void yCorner(actionListIter *pos);
-    void relativeDraw(actionListIter *pos);
-    void fill(actionListIter *pos);
-    void absoluteLine(actionListIter *pos);
-    void plotPattern(byte x, byte y);
-    void plotBrush(actionListIter *pos);
     void addCode(byte code);
     void replaceCode(byte code);
     void addPatCode();
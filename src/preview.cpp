@@ -19,6 +19,8 @@
  */
 
 
+#include <cstring>
+
 #include <QBoxLayout>
 #include <QCloseEvent>
 #include <QComboBox>
@@ -43,7 +45,7 @@
 
 //*****************************************
 Preview::Preview(QWidget *parent, const char  *name, ResourcesWin *res):
-    QStackedWidget(parent), animate(nullptr), resources_win(res)
+    QStackedWidget(parent), animate(nullptr), resources_win(res), prefetcher(std::make_unique<PreviewPrefetch>())
 {
     setWindowTitle("Preview");
     make_egacolors();
@@ -243,6 +245,10 @@ Preview::Preview(QWidget *parent, const char  *name, ResourcesWin *res):
     addWidget(w_logic);
 }
 
+//*****************************************
+Preview::~Preview()
+{ }
+
 //*****************************************
 void Preview::open(int ResNum, int type)
 {
@@ -278,6 +284,13 @@ void Preview::open(int ResNum, int type)
     show();
 }
 
+//*****************************************
+// Prepare the resources that are likely to be shown next.
+void Preview::prefetch(int type, const std::vector<int> &ResNums)
+{
+    prefetcher->request(type, ResNums);
+}
+
 //*****************************************
 void Preview::change_mode()
 {
@@ -418,6 +431,7 @@ void Preview::export_resource()
 //*****************************************
 void Preview::deinit()
 {
+    prefetcher->cancel();
     if (animate) {
         animate->closeall();
         animate = NULL;
@@ -457,35 +471,58 @@ PreviewPicture::PreviewPicture(QWidget *parent, const char  *name, Preview *p):
     ppicture = new BPicture();
 }
 
+//******************************************************
+PreviewPicture::~PreviewPicture()
+{
+    delete ppicture;
+}
+
 //*****************************************
-void PreviewPicture::draw(int ResNum)
+// Render a picture into 'ppicture' and return the visual screen followed by
+// the priority screen, the way rendered pictures are kept in the resource cache.
+static TCachedData render_picture(BPicture *ppicture, const std::vector<byte> &data)
 {
-    int err = game->ReadResource(PICTURE, ResNum);
-    if (!err) {
-        ppicture->show(ResourceData.Data, ResourceData.Size);
-        update();
+    const size_t plane = PIC_W * MAX_HH;
+
+    ppicture->show(data.data(), data.size());
+
+    auto rendered = std::make_shared<std::vector<byte>>(2 * plane);
+    for (int y = 0; y < MAX_HH; y++) {
+        memcpy(rendered->data() + y * PIC_W, ppicture->picture + y * BPicture::stride, PIC_W);
+        memcpy(rendered->data() + plane + y * PIC_W, ppicture->priority + y * BPicture::stride, PIC_W);
     }
+    return rendered;
+}
+
+//*****************************************
+// Pictures that were rendered before (or by the prefetch thread) come
+// from the resource cache.
+void PreviewPicture::draw(int ResNum)
+{
+    TCachedData data = game->LoadResourceData(PICTURE, ResNum);
+    if (!data)
+        return;
+
+    const size_t plane = PIC_W * MAX_HH;
+    TCachedData frame = game->cache.decoded(PICTURE, ResNum);
+    if (frame) {
+        for (int y = 0; y < MAX_HH; y++) {
+            memcpy(ppicture->picture + y * BPicture::stride, frame->data() + y * PIC_W, PIC_W);
+            memcpy(ppicture->priority + y * BPicture::stride, frame->data() + plane + y * PIC_W, PIC_W);
+        }
+    } else
+        game->cache.store_decoded(PICTURE, ResNum, data, render_picture(ppicture, *data));
+    update();
 }
 
 //*****************************************
 void PreviewPicture::update()
 {
     QPainter p(&pixmap);
-    byte **data;
-    int x, y;
-    byte c0 = 255, c;
+    byte *data;
 
     data = (drawing_mode) ? ppicture->priority : ppicture->picture;
-    for (y = 0; y < MAX_HH; y++) {
-        for (x = 0; x < MAX_W; x++) {
-            c = data[y][x];
-            if (c != c0) {
-                p.setPen(egacolor[c]);
-                c0 = c;
-            }
-            p.drawPoint(x, y);
-        }
-    }
+    p.drawImage(0, 0, picture_image(data, BPicture::stride));
     repaint();
 }
 
@@ -607,4 +644,88 @@ void PreviewView::show_description()
     if (ThisLine != "")
         preview->description->insertPlainText(ThisLine.c_str());
 }
+
+//******************************************************
+PreviewPrefetch::PreviewPrefetch() :
+    ResType(0), isV3(false), busy(false), quit(false)
+{
+    game->add_reader(this);
+    worker = std::thread(&PreviewPrefetch::run, this);
+}
+
+//*****************************************
+PreviewPrefetch::~PreviewPrefetch()
+{
+    game->remove_reader(this);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+        pending.clear();
+    }
+    wakeup.notify_one();
+    worker.join();
+}
+
+//*****************************************
+// Replace the resources waiting to be read. The one being read (if any)
+// is finished first; the UI thread never waits for it.
+void PreviewPrefetch::request(int type, const std::vector<int> &ResNums)
+{
+    std::vector<TPrefetchItem> items;
+    for (int ResNum : ResNums) {
+        if (game->ResourceInfo[type][ResNum].Exists)
+            items.push_back({ResNum, game->ResourceInfo[type][ResNum]});
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        ResType = type;
+        isV3 = game->isV3;
+        pending = std::move(items);
+    }
+    wakeup.notify_one();
+}
+
+//*****************************************
+void PreviewPrefetch::cancel()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    pending.clear();
+}
+
+//*****************************************
+// Called by the game before it changes its resource tables or VOL files
+void PreviewPrefetch::stopReading()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    pending.clear();
+    idle.wait(guard, [this] { return !busy; });
+}
+
+//*****************************************
+void PreviewPrefetch::run()
+{
+    BPicture ppicture;
+    std::unique_lock<std::mutex> guard(lock);
+
+    while (true) {
+        wakeup.wait(guard, [this] { return quit || !pending.empty(); });
+        if (quit)
+            return;
+        int type = ResType;
+        bool v3 = isV3;
+        TPrefetchItem item = pending.front();
+        pending.erase(pending.begin());
+        busy = true;
+        guard.unlock();
+
+        TCachedData data = game->LoadResourceData(type, item.ResNum, item.Info, v3);
+        if (data && type == PICTURE && !game->cache.has_decoded(PICTURE, item.ResNum))
+            game->cache.store_decoded(PICTURE, item.ResNum, data, render_picture(&ppicture, *data));
+        data = nullptr;
+
+        guard.lock();
+        busy = false;
+        idle.notify_all();
+    }
+}
 //*****************************************
@@ -22,9 +22,17 @@
 #define PREVIEW_H
 
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include <QWidget>
 #include <QStackedWidget>
 
+#include "game.h"
+
 
 class QComboBox;
 class QLabel;
@@ -62,6 +70,7 @@ class PreviewPicture : public QWidget
     Q_OBJECT
 public:
     PreviewPicture(QWidget *parent = 0, const char *name = 0, Preview *p = 0);
+    ~PreviewPicture();
     Preview *preview;
     BPicture *ppicture;
     QPixmap pixmap;
@@ -73,6 +82,37 @@ protected:
 
 };
 
+//****************************************************
+// Reads resources into the resource cache on a worker thread, ahead of the
+// preview. Pictures are rendered as well. (Views and logics are decoded
+// through shared buffers, so only their data is read.)
+// The worker never reads the game's resource tables: each request carries
+// a copy of the entries it needs, and the game stops the worker before it
+// changes them.
+class PreviewPrefetch : public BackgroundReader
+{
+public:
+    PreviewPrefetch();
+    ~PreviewPrefetch();
+    void request(int ResType, const std::vector<int> &ResNums);
+    void cancel();
+    void stopReading() override;
+private:
+    typedef struct {
+        int ResNum;
+        TResourceInfo Info;   // game->ResourceInfo entry when it was requested
+    } TPrefetchItem;
+    void run();
+    int ResType;
+    bool isV3;
+    std::vector<TPrefetchItem> pending;   // resources still to read, in this order
+    bool busy;                            // the worker is reading one
+    bool quit;
+    std::mutex lock;
+    std::condition_variable wakeup, idle;
+    std::thread worker;
+};
+
 class ResourcesWin;
 class LogEdit;
 
@@ -82,9 +122,11 @@ class Preview : public QStackedWidget
     Q_OBJECT
 public:
     Preview(QWidget *parent = 0, const char  *name = 0, ResourcesWin *res = 0);
+    ~Preview();
     QTextEdit *description;
     ResourcesWin *resources_win;
     void open(int i, int type);
+    void prefetch(int type, const std::vector<int> &ResNums);
 public slots:
     void double_click();
     void change_mode();
@@ -115,6 +157,7 @@ protected:
     QPushButton *loopleft, *loopright, *celleft, *celright;
     QLabel *loopnum, *celnum;
     Animate *animate;
+    std::unique_ptr<PreviewPrefetch> prefetcher;
     void deinit();
     void closeEvent(QCloseEvent *);
     void showEvent(QShowEvent *);
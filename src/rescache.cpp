@@ -0,0 +1,185 @@
+/*
+ *  QT AGI Studio :: Copyright (C) 2000 Helen Zommer
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+
+#include "rescache.h"
+
+
+//*******************************************
+ResourceCache::ResourceCache(size_t max_bytes) :
+    max_bytes(max_bytes), bytes(0), changes(0), counters()
+{ }
+
+//*******************************************
+// Find an entry and make it the most recently used one.
+ResourceCache::TCacheEntry *ResourceCache::touch(int key)
+{
+    auto iter = entries.find(key);
+    if (iter == entries.end())
+        return nullptr;
+    lru.splice(lru.begin(), lru, iter->second.Use);
+    return &iter->second;
+}
+
+//*******************************************
+size_t ResourceCache::entry_size(const TCacheEntry &entry) const
+{
+    return (entry.Raw ? entry.Raw->size() : 0) + (entry.Decoded ? entry.Decoded->size() : 0);
+}
+
+//*******************************************
+// Drop the least recently used entries until the cache fits its limit.
+// The most recently used entry is always kept.
+void ResourceCache::trim()
+{
+    while (bytes > max_bytes && lru.size() > 1) {
+        auto iter = entries.find(lru.back());
+        bytes -= entry_size(iter->second);
+        entries.erase(iter);
+        lru.pop_back();
+    }
+}
+
+//*******************************************
+// Data of the resource as read from the VOL file, or nullptr if it isn't cached.
+TCachedData ResourceCache::raw(int ResType, int ResNum)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    TCacheEntry *entry = touch(ResType * 256 + ResNum);
+    if (entry == nullptr || !entry->Raw) {
+        counters.RawMisses++;
+        return nullptr;
+    }
+    counters.RawHits++;
+    return entry->Raw;
+}
+
+//*******************************************
+// Changes whenever a resource is invalidated. Take it before reading a
+// resource and pass it to store_raw(), so that data read while the resource
+// was being changed is not cached.
+unsigned long ResourceCache::generation() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return changes;
+}
+
+//*******************************************
+void ResourceCache::store_raw(int ResType, int ResNum, TCachedData data, unsigned long read_generation)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (read_generation != changes)
+        return;
+
+    int key = ResType * 256 + ResNum;
+    TCacheEntry *entry = touch(key);
+    if (entry == nullptr) {
+        lru.push_front(key);
+        entry = &entries[key];
+        entry->Use = lru.begin();
+    }
+    bytes -= entry_size(*entry);
+    entry->Raw = std::move(data);
+    entry->Decoded.reset();   // it was made from the old data
+    bytes += entry_size(*entry);
+    trim();
+}
+
+//*******************************************
+// Decoded form of the resource, or nullptr if it isn't cached.
+TCachedData ResourceCache::decoded(int ResType, int ResNum)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    TCacheEntry *entry = touch(ResType * 256 + ResNum);
+    if (entry == nullptr || !entry->Decoded) {
+        counters.DecodedMisses++;
+        return nullptr;
+    }
+    counters.DecodedHits++;
+    return entry->Decoded;
+}
+
+//*******************************************
+// Like decoded() != nullptr, but doesn't count as a use of the resource.
+bool ResourceCache::has_decoded(int ResType, int ResNum) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto iter = entries.find(ResType * 256 + ResNum);
+    return (iter != entries.end() && iter->second.Decoded);
+}
+
+//*******************************************
+// Store the decoded form of a resource. 'from' is the data it was decoded
+// from; if that is no longer the cached data (the resource was changed or
+// dropped from the cache in the meantime), nothing is stored.
+void ResourceCache::store_decoded(int ResType, int ResNum, const TCachedData &from, TCachedData data)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    TCacheEntry *entry = touch(ResType * 256 + ResNum);
+    if (entry == nullptr || entry->Raw != from)
+        return;
+    bytes -= entry_size(*entry);
+    entry->Decoded = std::move(data);
+    bytes += entry_size(*entry);
+    trim();
+}
+
+//*******************************************
+// Forget a resource (must be called whenever it is changed or deleted).
+void ResourceCache::invalidate(int ResType, int ResNum)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    changes++;
+    auto iter = entries.find(ResType * 256 + ResNum);
+    if (iter == entries.end())
+        return;
+    bytes -= entry_size(iter->second);
+    lru.erase(iter->second.Use);
+    entries.erase(iter);
+}
+
+//*******************************************
+void ResourceCache::clear()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    changes++;
+    entries.clear();
+    lru.clear();
+    bytes = 0;
+}
+
+//*******************************************
+TCacheStats ResourceCache::stats() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    TCacheStats s = counters;
+    s.Entries = entries.size();
+    s.Bytes = bytes;
+    return s;
+}
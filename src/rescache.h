@@ -0,0 +1,81 @@
+/*
+ *  QT AGI Studio :: Copyright (C) 2000 Helen Zommer
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef RESCACHE_H
+#define RESCACHE_H
+
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+
+typedef unsigned char byte;
+
+typedef std::shared_ptr<const std::vector<byte>> TCachedData;
+
+// ResourceCache::stats() result
+typedef struct {
+    unsigned long RawHits, RawMisses;
+    unsigned long DecodedHits, DecodedMisses;
+    int Entries;          // resources in the cache
+    size_t Bytes;         // memory used by them
+} TCacheStats;
+
+//LRU cache of resources, keyed by type and number. For each resource it keeps
+//the data read from the VOL file and, optionally, a decoded form of it (e.g. a
+//rendered picture) that is stored by whoever decoded it. The least recently
+//used resources are dropped when the cache grows past its size limit.
+class ResourceCache
+{
+public:
+    explicit ResourceCache(size_t max_bytes);
+    TCachedData raw(int ResType, int ResNum);
+    unsigned long generation() const;
+    void store_raw(int ResType, int ResNum, TCachedData data, unsigned long read_generation);
+    TCachedData decoded(int ResType, int ResNum);
+    bool has_decoded(int ResType, int ResNum) const;
+    void store_decoded(int ResType, int ResNum, const TCachedData &from, TCachedData data);
+    void invalidate(int ResType, int ResNum);
+    void clear();
+    TCacheStats stats() const;
+private:
+    typedef struct {
+        TCachedData Raw;
+        TCachedData Decoded;
+        std::list<int>::iterator Use;   // position in the 'lru' list
+    } TCacheEntry;
+
+    TCacheEntry *touch(int key);
+    size_t entry_size(const TCacheEntry &entry) const;
+    void trim();
+
+    size_t max_bytes, bytes;
+    unsigned long changes;   // number of invalidate() and clear() calls
+    std::unordered_map<int, TCacheEntry> entries;  // key is ResType * 256 + ResNum
+    std::list<int> lru;                            // most recently used first
+    TCacheStats counters;
+    mutable std::mutex lock;
+};
+
+
+#endif
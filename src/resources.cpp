@@ -127,6 +127,22 @@ void ResourcesWin::highlight_resource(int k)
     preview->open(i, selected);
     groupBoxPreview->layout()->addWidget(preview);
     preview->show();
+
+    // get the neighbours ready while the user looks at this one
+    std::vector<int> neighbours;
+    for (int d = 1; d <= PrefetchRange; d++) {
+        if (k + d < listWidgetResources->count())
+            neighbours.push_back(ResourceIndex[k + d]);
+        if (k - d >= 0)
+            neighbours.push_back(ResourceIndex[k - d]);
+    }
+    preview->prefetch(selected, neighbours);
+
+    TCacheStats stats = game->cache.stats();
+    statusBar()->setToolTip(QString::asprintf("Resource cache: %d resources, %.1f MB\n"
+                                              "Data: %lu hits, %lu misses\nDecoded: %lu hits, %lu misses",
+                                              stats.Entries, stats.Bytes / 1048576.0,
+                                              stats.RawHits, stats.RawMisses, stats.DecodedHits, stats.DecodedMisses));
 }
 
 //********************************************************
@@ -288,12 +304,16 @@ void ResourcesWin::renumber_resource()
                                  tr("Resource %1.%2 already exists. Replace it?").arg(ResTypeName[restype]).arg(QString::number(newnum), 3, QChar('0')),
                                  QMessageBox::Yes | QMessageBox::No,
                                  QMessageBox::No)) {
-        case QMessageBox::Yes:
-            game->ReadResource(restype, resnum);
+        case QMessageBox::Yes: {
+            AGIResource res = game->LoadResource(restype, resnum);
+            if (res.empty())
+                break;
             game->DeleteResource(restype, resnum);
-            game->AddResource(restype, newnum);
+            res.Num = newnum;
+            game->AddResource(res);
             select_resource_type(restype);
-            break;
+        }
+        break;
         default:
             break;
     }
@@ -351,10 +371,11 @@ void ResourcesWin::import_resource()
                 menu->errmes(err);
                 return;
             }
-            ResourceData.Size = res.size();
-            memcpy(ResourceData.Data, res.data(), res.size());
-
-            game->AddResource(restype, newnum); // uses data from ResourceData
+            AGIResource picture;
+            picture.Type = restype;
+            picture.Num = newnum;
+            picture.Data.assign(res.begin(), res.end());
+            game->AddResource(picture);
             select_resource_type(restype);
 
             for (int k = 0; k < 255; ++k)
@@ -367,29 +388,6 @@ void ResourcesWin::import_resource()
     }
 }
 
-//**********************************************
-static void extract(const std::string &filename, int restype, int resnum)
-{
-    if (game->ReadResource(restype, resnum))
-        return;
-
-    QFile outfile(filename.c_str());
-    if (!outfile.open(QIODevice::WriteOnly)) {
-        menu->errmes("Can't open file '%s'!", filename.c_str());
-        return;
-    }
-
-    if (restype == LOGIC && game->settings->value("ExtractLogicAsText").toBool()) {
-        Logic *logic = new Logic();
-        int err = logic->decode(resnum);
-        if (!err)
-            outfile.write(logic->OutputText.c_str());
-        delete logic;
-    } else
-        outfile.write(reinterpret_cast<char *>(ResourceData.Data), ResourceData.Size);
-    outfile.close();
-}
-
 //**********************************************
 void ResourcesWin::extract_resource()
 {
@@ -401,7 +399,7 @@ void ResourcesWin::extract_resource()
 
     QString fileName = QFileDialog::getSaveFileName(this, tr("Extract Resource"), defaultpath, tr("All Files (*)"));
     if (!fileName.isNull())
-        extract(fileName.toStdString(), restype, resnum);
+        game->ExtractResource(fileName.toStdString(), restype, resnum, game->settings->value("ExtractLogicAsText").toBool());
 }
 
 //**********************************************
@@ -422,7 +420,7 @@ void ResourcesWin::extract_all_resource()
     for (int resnum = 0; resnum < 256; resnum++) {
         if (game->ResourceInfo[restype][resnum].Exists) {
             filename = QString("%1/%2.%3").arg(game->srcdir.c_str()).arg(ResTypeName[restype]).arg(QString::number(resnum), 3, '0');
-            extract(filename.toStdString(), restype, resnum);
+            game->ExtractResource(filename.toStdString(), restype, resnum, game->settings->value("ExtractLogicAsText").toBool());
         }
     }
 }
@@ -451,12 +449,14 @@ void ResourcesWin::export_resource()
     int i = ResourceIndex[k];
 
     switch (selected) {
-        case SOUND:
-            if (game->ReadResource(SOUND, i))
+        case SOUND: {
+            AGIResource res = game->LoadResource(SOUND, i);
+            if (res.empty())
                 menu->errmes("Couldn't read sound resource! ");
             else
-                showSaveAsMidi(this, ResourceData.Data);
-            break;
+                showSaveAsMidi(this, res.Data.data());
+        }
+        break;
         default:
             qWarning("Export not supported for this resource type!");
             break;
@@ -554,10 +554,8 @@ void AddResource::edit_cb(const QString &str)
 }
 
 //**********************************************
-static int load_resource(const std::string &filename, int restype)
+static int load_resource(const std::string &filename, int restype, AGIResource &res)
 {
-    extern QStringList InputLines;
-
     QFile infile(filename.c_str());
     if (!infile.open(QIODevice::ReadOnly)) {
         menu->errmes("Can't open file '%s'!", filename.c_str());
@@ -575,14 +573,14 @@ static int load_resource(const std::string &filename, int restype)
         int sample_size = std::min(size, 64);
 
         // Check if file contains non-text data
-        infile.read(reinterpret_cast<char *>(ResourceData.Data), sample_size);
+        res.Data.resize(size);
+        infile.read(reinterpret_cast<char *>(res.Data.data()), sample_size);
         for (int i = 0; i < sample_size; i++) {
-            unsigned char b = ResourceData.Data[i];
+            unsigned char b = res.Data[i];
             if (b > 0x80 || (b < 0x20 && b != 0x0a && b != 0x0d && b != 0x09)) {
                 // File is binary
                 infile.seek(0);
-                ResourceData.Size = size;
-                infile.read(reinterpret_cast<char *>(ResourceData.Data), ResourceData.Size);
+                infile.read(reinterpret_cast<char *>(res.Data.data()), size);
                 infile.close();
                 return 0;
             }
@@ -591,19 +589,21 @@ static int load_resource(const std::string &filename, int restype)
         // File appears to be text - trying to compile...
         infile.seek(0);
         Logic *logic = new Logic();
-        InputLines.clear();
+        logic->InputLines.clear();
         QTextStream instream(&infile);
         QString line;
         while (instream.readLineInto(&line))
-            InputLines.append(line);
+            logic->InputLines.append(line);
         infile.close();
         int err = logic->compile();
+        if (!err)
+            res.Data = std::move(logic->Resource.Data);
         delete logic;
         if (err)
             return 1;
     } else {
-        ResourceData.Size = size;
-        infile.read(reinterpret_cast<char *>(ResourceData.Data), ResourceData.Size);
+        res.Data.resize(size);
+        infile.read(reinterpret_cast<char *>(res.Data.data()), size);
         infile.close();
     }
     return 0;
@@ -624,16 +624,23 @@ void AddResource::ok_cb()
                                      tr("Resource %1.%2 already exists. Replace it?").arg(ResTypeName[restype]).arg(QString::number(num), 3, QChar('0')),
                                      QMessageBox::Yes | QMessageBox::No,
                                      QMessageBox::No)) {
-            case QMessageBox::Yes:
-                if (!load_resource(file, restype))
-                    game->AddResource(restype, num);
-                break;
+            case QMessageBox::Yes: {
+                AGIResource res;
+                res.Type = restype;
+                res.Num = num;
+                if (!load_resource(file, restype, res))
+                    game->AddResource(res);
+            }
+            break;
             default:
                 break;
         }
     } else {
-        if (!load_resource(file, restype)) {
-            game->AddResource(restype, num);
+        AGIResource res;
+        res.Type = restype;
+        res.Num = num;
+        if (!load_resource(file, restype, res)) {
+            game->AddResource(res);
             if (resources_win->selected == restype)
                 resources_win->select_resource_type(restype);
         }
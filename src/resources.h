@@ -40,6 +40,8 @@ class QListWidgetItem;
 class ResourcesWin;
 class Preview;
 
+#define PrefetchRange 4   // resources before and after the selected one to read ahead
+
 class AddResource : public QWidget
 {
     Q_OBJECT
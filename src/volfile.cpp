@@ -0,0 +1,127 @@
+/*
+ *  QT AGI Studio :: Copyright (C) 2000 Helen Zommer
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+#include <algorithm>
+#include <filesystem>
+
+#include <QFile>
+
+#include "volfile.h"
+
+
+//*******************************************
+VolFile::VolFile() :
+    Data(nullptr), Size(0)
+{ }
+
+//*******************************************
+VolFile::~VolFile()
+{ }
+
+//*******************************************
+bool VolFile::open(const std::string &path)
+{
+    file = std::make_unique<QFile>(QString::fromStdString(path));
+    if (!file->open(QIODevice::ReadOnly))
+        return false;
+
+    Size = file->size();
+    if (Size == 0) {
+        // empty VOL files can't be mapped, but they are valid
+        Data = nullptr;
+        return true;
+    }
+
+    Data = file->map(0, Size);
+    return (Data != nullptr);
+}
+
+//*******************************************
+static std::string lower_case(const std::string &str)
+{
+    std::string s = str;
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+//*******************************************
+// Unmap all files (must be called before VOL files are deleted or renamed).
+void VolFileSet::reset(const std::string &gamedir)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    files.clear();
+    dir = gamedir;
+}
+
+//*******************************************
+// Unmap one file (must be called before the file is written to).
+// The mapping is recreated with the new size when it is needed again;
+// views of the old mapping keep it alive until they are gone.
+void VolFileSet::invalidate(const std::string &filename)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    files.erase(lower_case(filename));
+}
+
+//*******************************************
+// Find the resource at 'loc' in VOL file 'filename' and validate its header.
+// The resource data is not copied - res->Data points into the mapped file.
+// Can be called from any thread.
+int VolFileSet::view(const std::string &filename, long loc, bool isV3, TResourceView *res)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto key = lower_case(filename);
+    auto iter = files.find(key);
+    if (iter == files.end()) {
+        auto vol = std::make_shared<VolFile>();
+        if (!vol->open((std::filesystem::path(dir) / filename).string()))
+            return VOL_ERR_OPEN;
+        iter = files.emplace(key, std::move(vol)).first;
+    }
+
+    const VolFile *vol = iter->second.get();
+    res->File = iter->second;
+    int header_size = isV3 ? 7 : 5;
+    if (loc < 0 || loc + header_size > vol->size())
+        return VOL_ERR_PAST_END;
+
+    const byte *header = vol->data() + loc;
+    if (!(header[0] == 0x12 && header[1] == 0x34))
+        return VOL_ERR_NO_SIG;
+
+    res->VolByte = header[2];
+    res->UncompressedSize = header[4] * 256 + header[3];
+    if (isV3)
+        res->Size = header[6] * 256 + header[5];
+    else
+        res->Size = res->UncompressedSize;
+    res->Compressed = isV3 && ((res->Size != res->UncompressedSize) || (res->VolByte & 0x80));
+    if (res->Size == 0)
+        return VOL_ERR_SIZE;
+
+    // a resource cut short by the end of the file is read as far as it goes
+    res->Data = header + header_size;
+    if (loc + header_size + res->Size > vol->size())
+        res->Size = vol->size() - loc - header_size;
+
+    return VOL_OK;
+}
@@ -0,0 +1,89 @@
+/*
+ *  QT AGI Studio :: Copyright (C) 2000 Helen Zommer
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef VOLFILE_H
+#define VOLFILE_H
+
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+
+class QFile;
+class VolFile;
+
+typedef unsigned char byte;
+
+// Resource as it is stored in a VOL file. Data points into the mapped file,
+// which stays mapped for as long as the view exists.
+typedef struct {
+    const byte *Data;       // resource data (compressed in v3 games)
+    int Size;               // size of the data in the VOL file
+    int UncompressedSize;   // size after decompression (same as Size in v2 games)
+    bool Compressed;        // v3 resource stored in compressed form
+    byte VolByte;           // vol number; bit 7 is set for v3 compressed pictures
+    std::shared_ptr<const VolFile> File;
+} TResourceView;
+
+// VolFileSet::view() error codes
+#define VOL_OK           0
+#define VOL_ERR_OPEN     1  // can't open or map the VOL file
+#define VOL_ERR_PAST_END 2  // resource location is past end of file
+#define VOL_ERR_NO_SIG   3  // resource signature (0x12 0x34) not found
+#define VOL_ERR_SIZE     4  // resource size is 0
+
+//memory-mapped VOL file
+class VolFile
+{
+public:
+    VolFile();
+    ~VolFile();
+    bool open(const std::string &path);
+    const byte *data() const
+    {
+        return Data;
+    }
+    long size() const
+    {
+        return Size;
+    }
+private:
+    std::unique_ptr<QFile> file;
+    const byte *Data;
+    long Size;
+};
+
+//all VOL files of a game; each one is mapped once, on first use
+class VolFileSet
+{
+public:
+    void reset(const std::string &gamedir);
+    void invalidate(const std::string &filename);
+    int view(const std::string &filename, long loc, bool isV3, TResourceView *res);
+private:
+    std::string dir;
+    std::map<std::string, std::shared_ptr<VolFile>> files;  // key is the lower case filename
+    std::mutex lock;
+};
+
+
+#endif
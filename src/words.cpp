@@ -35,33 +35,37 @@
 #define MaxGroupNum 65535
 #define MaxWordGroups 10000
 
-static int ResPos;
-static bool EndOfFileReached;
+// WORDS.TOK file being parsed
+typedef struct {
+    std::vector<byte> Data;
+    int ResPos;
+    bool EndOfFileReached;
+} TWordsFile;
 
 //***************************************************
 WordList::WordList() {}
 
 //***************************************************
-static byte ReadByte(void)
+static byte ReadByte(TWordsFile *f)
 {
     byte ret;
-    if (ResPos < ResourceData.Size) {
-        ret = ResourceData.Data[ResPos];
-        ResPos++;
+    if (f->ResPos < (int)f->Data.size()) {
+        ret = f->Data[f->ResPos];
+        f->ResPos++;
     } else {
         ret = 0;
-        EndOfFileReached = true;
+        f->EndOfFileReached = true;
     }
     return ret;
 }
 
 //***************************************************
-static int ReadMSLSWord(void)
+static int ReadMSLSWord(TWordsFile *f)
 {
     byte MSbyte, LSbyte;
 
-    MSbyte = ReadByte();
-    LSbyte = ReadByte();
+    MSbyte = ReadByte(f);
+    LSbyte = ReadByte(f);
     return (MSbyte * 256 + LSbyte);
 }
 
@@ -119,36 +123,37 @@ int WordList::read(const std::string &filename)
         return 1;
     }
 
-    EndOfFileReached = false;
-    ResourceData.Size = size;
-    word_stream.read(reinterpret_cast<char *>(ResourceData.Data), size);
+    TWordsFile f;
+    f.EndOfFileReached = false;
+    f.Data.resize(size);
+    word_stream.read(reinterpret_cast<char *>(f.Data.data()), size);
     word_stream.close();
 
     WordGroup.clear();          // Empty the existing WordGroups before we begin
 
-    ResPos = 0;
-    ResPos = ReadMSLSWord();    // Start of words section
+    f.ResPos = 0;
+    f.ResPos = ReadMSLSWord(&f);    // Start of words section
     PrevWord = "";
     do {
         CurWord = "";
-        CharsFromPrevWord = ReadByte();
+        CharsFromPrevWord = ReadByte(&f);
         if (CharsFromPrevWord > PrevWord.length())
             CharsFromPrevWord = PrevWord.length();
         if (CharsFromPrevWord > 0)
             CurWord = PrevWord.substr(0, CharsFromPrevWord);
         do {
-            CurByte = ReadByte();
+            CurByte = ReadByte(&f);
             if (CurByte < 0x80)
                 CurWord += (CurByte ^ 0x7f);
-        } while (CurByte < 0x80 && !EndOfFileReached);
+        } while (CurByte < 0x80 && !f.EndOfFileReached);
         // We must check for end of file, otherwise if the file is invalid, the
         // program may read indefinitely.
-        if (EndOfFileReached) {
+        if (f.EndOfFileReached) {
             menu->errmes("Error! Invalid WORDS.TOK file.");
             return 1;
         }
         CurWord += (0x7F ^ (CurByte - 0x80));
-        GroupNum = ReadMSLSWord();
+        GroupNum = ReadMSLSWord(&f);
         if (CurWord != PrevWord) {  //this word different to previous, so add it
             //in this way, no duplicates are added
             if (WordGroup.contains(GroupNum)) {
@@ -165,12 +170,12 @@ int WordList::read(const std::string &filename)
             }
             PrevWord = CurWord;
         }
-        CurByte = ReadByte();
-        if (CurByte == 0 && ResPos >= ResourceData.Size - 1)
-            EndOfFileReached = true;
+        CurByte = ReadByte(&f);
+        if (CurByte == 0 && f.ResPos >= (int)f.Data.size() - 1)
+            f.EndOfFileReached = true;
         else
-            ResPos--;
-    } while (!EndOfFileReached);
+            f.ResPos--;
+    } while (!f.EndOfFileReached);
 
     return 0;
 }